@@ -0,0 +1,317 @@
+#include <blackjack/anytime.hpp>
+#include <blackjack/initial_deals.hpp>
+#include <blackjack/scenario.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace {
+
+using namespace blackjack;
+
+template<class T>
+inline void
+do_not_optimize(T const &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+auto
+peak_rss_kb() -> long
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+/// One JSON object per line, so runs can be appended to a log and compared
+/// across releases.
+///
+/// ru_maxrss is the high-water mark of the whole process, so a report takes
+/// it when made and gives how far the benchmark raised it: the memory the
+/// benchmark needed beyond the peak of those before it, or 0 if it stayed
+/// under that peak. Make the report just before the work it measures.
+struct report
+{
+    explicit report(
+        std::string name,
+        std::size_t iterations = 0)
+        : name(std::move(name))
+        , iterations(iterations)
+        , rss_before_kb(peak_rss_kb())
+    {}
+
+    std::string name;
+    std::size_t iterations = 0;
+    double seconds = 0.0;
+    /// left out where the engines' tables are not visible to the benchmark
+    std::optional<std::size_t> memo_entries;
+
+    /// for checks: the largest difference from the reference result
+    std::optional<double> max_abs_diff;
+
+    /// for approximations: the error bound they report
+    std::optional<double> error_bound;
+
+    /// the process's peak resident set size when the report was made
+    long rss_before_kb;
+
+    void
+    print(std::ostream &os) const
+    {
+        os << "{\"name\":\"" << name << "\""
+           << ",\"iterations\":" << iterations
+           << ",\"seconds\":" << seconds
+           << ",\"ns_per_op\":" << (iterations ? seconds * 1e9 / double(iterations) : 0.0);
+        if (memo_entries)
+            os << ",\"memo_entries\":" << *memo_entries;
+        if (max_abs_diff)
+            os << ",\"max_abs_diff\":" << *max_abs_diff;
+        if (error_bound)
+            os << ",\"error_bound\":" << *error_bound;
+        os << ",\"peak_rss_growth_kb\":" << peak_rss_kb() - rss_before_kb
+           << "}" << std::endl;
+    }
+};
+
+auto
+elapsed(std::chrono::steady_clock::time_point since) -> double
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+/// Runs `batch` (which performs `per_batch` operations) until at least
+/// `min_seconds` have passed.
+auto
+run_micro(
+    std::string name,
+    std::size_t per_batch,
+    std::function<void()> const &batch,
+    double min_seconds) -> report
+{
+    auto r = report(std::move(name));
+    auto start = std::chrono::steady_clock::now();
+    do
+    {
+        batch();
+        r.iterations += per_batch;
+    } while (elapsed(start) < min_seconds);
+    r.seconds = elapsed(start);
+    return r;
+}
+
+auto
+sample_hands() -> std::vector<player_hand>
+{
+    auto result = std::vector<player_hand>();
+    for (auto a : all_card_faces())
+        for (auto b : all_card_faces())
+            for (auto c : all_card_faces())
+                result.push_back(player_hand(a, b, c));
+    return result;
+}
+
+auto
+dealt_shoe(
+    rules const &r,
+    player_hand const &p,
+    dealer_hand const &d) -> shoe
+{
+    auto s = shoe(r.no_of_decks, r.cards_behind_cut);
+    for (auto c : all_card_faces())
+    {
+        for (auto n = p[c] ; n-- ; )
+            s -= c;
+        for (auto n = d[c] ; n-- ; )
+            s -= c;
+    }
+    return s;
+}
+
+auto
+deck_rules(int decks) -> rules
+{
+    auto r = rules();
+    r.no_of_decks = decks;
+    r.cards_behind_cut = decks * 52 / 6;
+    return r;
+}
+
+void
+micro_benchmarks(
+    std::ostream &os,
+    double min_seconds)
+{
+    auto hands = sample_hands();
+    run_micro("score", hands.size(), [&] {
+        for (auto &&h : hands)
+            do_not_optimize(score(h));
+    }, min_seconds).print(os);
+
+    auto r = deck_rules(8);
+    auto s = shoe(r.no_of_decks, r.cards_behind_cut);
+    auto d = dealer_hand(card_scale::six);
+    run_micro("player_key_hash", hands.size(), [&] {
+        for (auto &&h : hands)
+            do_not_optimize(hash_value(scenario::make_player_key(h, d, s, cards())));
+    }, min_seconds).print(os);
+
+    auto memo = scenario::player_memo_map();
+    auto keys = std::vector<scenario::player_key>();
+    for (auto &&h : hands)
+    {
+        keys.push_back(scenario::make_player_key(h, d, s, cards()));
+        memo.insert(keys.back(), memo_result(scenario_result(player_action::stick)));
+    }
+    auto probe = run_micro("memo_probe_hit", keys.size(), [&] {
+        for (auto &&k : keys)
+            do_not_optimize(memo.find(k));
+    }, min_seconds);
+    probe.memo_entries = memo.size();
+    probe.print(os);
+
+    for (int decks : { 1, 8 })
+    {
+        auto dr = deck_rules(decks);
+        auto sc = scenario(dr);
+        auto up = dealer_hand(card_scale::two);
+        auto ds = dealt_shoe(dr, player_hand(), up);
+        auto rep = run_micro("dealer_outcomes_cold/" + std::to_string(decks) + "deck", 1, [&] {
+            sc.memo_.clear();
+            do_not_optimize(sc.dealer_outcomes(ds, up, cards()));
+        }, min_seconds);
+        rep.memo_entries = sc.memo_.size();
+        rep.print(os);
+    }
+}
+
+void
+macro_benchmarks(
+    std::ostream &os,
+    std::size_t threads)
+{
+    struct decision
+    {
+        const char *name;
+        player_hand p;
+        dealer_hand d;
+    };
+    auto decisions = std::vector<decision> {
+        { "T6v9", player_hand(card_scale::ten, card_scale::six), dealer_hand(card_scale::nine) },
+        { "32v6", player_hand(card_scale::three, card_scale::two), dealer_hand(card_scale::six) },
+        { "A2v5", player_hand(card_scale::ace, card_scale::two), dealer_hand(card_scale::five) },
+    };
+
+    for (int decks : { 1, 2, 6, 8 })
+    {
+        auto r = deck_rules(decks);
+        for (auto &&dec : decisions)
+        {
+            auto rep = report(std::string("decision/") + dec.name + "/" + std::to_string(decks) + "deck", 1);
+            auto sc = scenario(r);
+            auto s = dealt_shoe(r, dec.p, dec.d);
+            auto start = std::chrono::steady_clock::now();
+            do_not_optimize(sc.run(s, dec.p, dec.d, cards()));
+            rep.seconds = elapsed(start);
+            rep.memo_entries = sc.memo_.size() + sc.player_memo_.size();
+            rep.print(os);
+        }
+    }
+
+    // the same 8 deck decisions with the search pruned, against exact
+    auto r8 = deck_rules(8);
+    for (auto &&dec : decisions)
+    {
+        auto s = dealt_shoe(r8, dec.p, dec.d);
+        auto exact = scenario(r8).run(s, dec.p, dec.d, cards());
+        for (double epsilon : { 1e-9, 1e-8, 1e-7 })
+        {
+            auto opts = scenario_options();
+            opts.epsilon = epsilon;
+            auto name = std::ostringstream();
+            name << "pruned/" << dec.name << "/8deck/eps" << epsilon;
+            auto rep = report(name.str(), 1);
+            auto sc = scenario(r8, opts);
+            auto start = std::chrono::steady_clock::now();
+            auto result = sc.run(s, dec.p, dec.d, cards());
+            rep.seconds = elapsed(start);
+            rep.memo_entries = sc.memo_.size() + sc.player_memo_.size();
+            rep.max_abs_diff = std::abs(result.pnl() - exact.pnl());
+            rep.error_bound = result.error;
+            rep.print(os);
+        }
+    }
+
+    // and answered within a time budget, against exact
+    for (auto &&dec : decisions)
+    {
+        auto s = dealt_shoe(r8, dec.p, dec.d);
+        auto exact = scenario(r8).run(s, dec.p, dec.d, cards());
+        for (int budget_ms : { 1, 10, 100 })
+        {
+            auto opts = scenario_options();
+            opts.time_budget = std::chrono::milliseconds(budget_ms);
+            auto rep = report(std::string("anytime/") + dec.name + "/8deck/" +
+                              std::to_string(budget_ms) + "ms", 1);
+            auto sc = anytime_scenario(r8, opts);
+            auto start = std::chrono::steady_clock::now();
+            auto result = sc.run(s, dec.p, dec.d, cards());
+            rep.seconds = elapsed(start);
+            rep.max_abs_diff = std::abs(result.pnl() - exact.pnl());
+            rep.error_bound = result.error;
+            rep.print(os);
+        }
+    }
+
+    auto r = rules();
+    auto rep = report("iterate_all/1deck/" + std::to_string(threads) + "threads", 1);
+    auto start = std::chrono::steady_clock::now();
+    do_not_optimize(iterate_all(r, threads));
+    rep.seconds = elapsed(start);
+    rep.print(os);
+}
+
+} // namespace
+
+int
+main(
+    int argc,
+    char **argv)
+{
+    auto threads = polyfill::default_concurrency();
+    auto min_seconds = 0.5;
+    auto run_micro_set = true;
+    auto run_macro_set = true;
+    for (int i = 1 ; i < argc ; ++i)
+    {
+        auto arg = std::string(argv[i]);
+        if (arg == "--threads" and i + 1 < argc)
+            threads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--min-seconds" and i + 1 < argc)
+            min_seconds = std::atof(argv[++i]);
+        else if (arg == "--micro")
+            run_macro_set = false;
+        else if (arg == "--macro")
+            run_micro_set = false;
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--threads N] [--min-seconds S] [--micro | --macro]\n";
+            return 1;
+        }
+    }
+
+    if (run_micro_set)
+        micro_benchmarks(std::cout, min_seconds);
+    if (run_macro_set)
+        macro_benchmarks(std::cout, threads);
+    return 0;
+}
@@ -1,63 +1,33 @@
+#include <blackjack/anytime.hpp>
+#include <blackjack/batch.hpp>
+#include <blackjack/effects_of_removal.hpp>
+#include <blackjack/infinite_deck.hpp>
+#include <blackjack/initial_deals.hpp>
 #include <blackjack/scenario.hpp>
+#include <blackjack/simulator.hpp>
+#include <blackjack/speculator.hpp>
+#include <blackjack/strategy_chart.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <type_traits>
 
 #include "blackjack/rules.hpp"
 #include "blackjack/shoe.hpp"
 #include <boost/algorithm/string.hpp>
 
 namespace blackjack {
-outcome
-check(
-    scenario &s,
-    shoe const &sh,
-    player_hand const &p,
-    dealer_hand const &d)
-{
-    auto result = s.run(sh, p, d, cards());
-    std::cout << "player has " << p << " vs dealer's " << d << " player should "
-              << result << '\n';
-    return result;
-}
-
-void
-iterate_all(
-    scenario &s,
-    outcome &accum)
-{
-    auto sh = blackjack::shoe(1);
-
-    auto one = [&](
-        card_scale p1,
-        card_scale p2,
-        card_scale d) {
-        auto player = player_hand(p1, p2);
-        auto dealer = dealer_hand(d);
-        auto prob_comp = draw_probability(sh);
-        auto prob =
-            prob_comp.update(p1) * prob_comp.update(p2) * prob_comp.update(d);
-        sh -= p1;
-        sh -= p2;
-        sh -= d;
-        auto result = check(s, sh, player, dealer) * prob;
-        sh += p1;
-        sh += p2;
-        sh += d;
-        return result;
-    };
-
-    //  one(card_scale::ten, card_scale::ace, card_scale::nine);
-
-    for (auto p1 : all_card_faces())
-        for (auto p2 : all_card_faces())
-            for (auto d : all_card_faces())
-                accum += one(to_card_scale(p1), to_card_scale(p2), to_card_scale(d));
-}
 
+template<class Engine = scenario>
 void
-play(rules const &r)
+play(
+    rules const &r,
+    scenario_options const &opts,
+    snapshot_builder *collect)
 {
-    auto s = scenario(r);
+    auto s = Engine(r, opts);
     auto burn_pile = blackjack::cards();
     auto dealer_shoe = blackjack::shoe(r.no_of_decks, r.cards_behind_cut);
 
@@ -66,6 +36,28 @@ play(rules const &r)
     auto player = player_hand();
     auto dealer = dealer_hand();
 
+    // the work and time of the most recent suggestion, for the stats command
+    auto last_decision = scenario_stats();
+    auto last_seconds = 0.0;
+
+    // why and whylog explain with a traced engine of their own, so the
+    // suggestions' memo tables survive an explanation.
+    auto explain = [&](std::ostream &log) {
+        auto traced = traced_scenario(r, opts);
+        traced.chat(&log);
+        traced.run(dealer_shoe, player, dealer, burn_pile);
+    };
+
+    // while the user reads a suggestion, the engine works ahead on the
+    // deals of the next round; it is stopped before anything else uses s
+    auto spec = speculator(s);
+    auto speculate = [&] {
+        auto next_burn_pile = burn_pile;
+        next_burn_pile += dealer;
+        next_burn_pile += player;
+        spec.start(dealer_shoe, next_burn_pile);
+    };
+
     while (1)
     {
         std::cout << "enter command, ? for help: " << std::flush;
@@ -80,6 +72,7 @@ play(rules const &r)
                          "\n  play = play a random hand"
                          "\n  why = ask for an explanation of the play suggestion"
                          "\n  whylog = ask for an explanation placed in a file called why.txt"
+                         "\n  stats = show the engine's memo and recursion counters"
                          "\n  quit = quit the game"
                          "\n";
             continue;
@@ -95,6 +88,7 @@ play(rules const &r)
         }
         else if (boost::iequals(command, "play"))
         {
+            spec.stop();
             burn_pile += std::move(dealer);
             burn_pile += std::move(player);
             auto deal_to = [&](
@@ -117,18 +111,21 @@ play(rules const &r)
             deal_to("player: ", player);
 
             std::cout << "player has: " << player << ", dealer has: " << dealer << std::endl;
-            std::cout << "suggested play: " << s.run(dealer_shoe, player, dealer, burn_pile) << std::endl;
+            auto before = s.stats();
+            auto start = std::chrono::steady_clock::now();
+            auto suggestion = s.run(dealer_shoe, player, dealer, burn_pile);
+            last_seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            last_decision = s.stats() - before;
+            std::cout << "suggested play: " << suggestion << std::endl;
+            speculate();
         }
         else if (boost::iequals(command, "why"))
         {
             if (player.empty())
                 std::cout << "why what?\n";
             else
-            {
-                s.chat(&std::cout);
-                s.run(dealer_shoe, player, dealer, burn_pile);
-                s.chat(nullptr);
-            }
+                explain(std::cout);
         }
         else if (boost::iequals(command, "whylog"))
         {
@@ -139,32 +136,219 @@ play(rules const &r)
                 << "\nplayer hand : " << player
                 << "\ndealer hand : " << dealer
                 << '\n';
-            s.chat(&log);
-            s.run(dealer_shoe, player, dealer, burn_pile);
-            s.chat(nullptr);
+            explain(log);
+        }
+        else if (boost::iequals(command, "stats"))
+        {
+            spec.stop();
+            std::cout << "engine totals:\n" << s.stats() << '\n';
+            if (!player.empty())
+                std::cout << "last decision (" << player << " vs " << dealer << ", "
+                          << last_seconds << "s):\n" << last_decision << '\n';
+            if (!player.empty())
+                speculate();
         }
         else if (boost::iequals(command, "quit"))
         {
             break;
         }
     }
+
+    spec.stop();
+    if (collect)
+        collect->add(s);
+}
+
+/// Calls f with a std::type_identity of the engine named on the command
+/// line; the exact engine is specialized for the rules `r`.
+template<class F>
+auto
+with_engine(
+    std::string const &name,
+    rules const &r,
+    F &&f)
+{
+    if (name == "infinite")
+        return f(std::type_identity<infinite_deck_scenario>());
+    if (name == "eor")
+        return f(std::type_identity<eor_scenario>());
+    if (name == "anytime")
+        return f(std::type_identity<anytime_scenario>());
+    return dispatch_rules(r, [&](auto rule_set) {
+        return f(std::type_identity<specialized_scenario<typename decltype(rule_set)::type>>());
+    });
 }
 
 } // namespace blackjack
 
 int
-main()
+main(
+    int argc,
+    char **argv)
 {
     auto rules = blackjack::rules();
-    blackjack::play(rules);
-    auto scenario = blackjack::scenario(rules);
-    auto burn_pile = blackjack::cards();
-    auto shoe = blackjack::shoe(rules.no_of_decks, rules.cards_behind_cut);
+    auto threads = polyfill::default_concurrency();
+    auto engine = std::string("exact");
+    auto chart_format = std::string();
+    auto batch_input = std::string();
+    auto batch_format = std::string("jsonl");
+    auto output = std::string();
+    auto simulate_rounds = std::uint64_t(0);
+    auto seed = std::uint64_t(0);
+    auto snapshot_load = std::string();
+    auto snapshot_save = std::string();
+    auto epsilon = 0.0;
+    auto budget_ms = 100.0;
+    for (int i = 1 ; i < argc ; ++i)
+    {
+        auto arg = std::string(argv[i]);
+        if (arg == "--threads" and i + 1 < argc)
+            threads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--engine" and i + 1 < argc)
+            engine = argv[++i];
+        else if (arg == "--decks" and i + 1 < argc)
+        {
+            rules.no_of_decks = std::clamp(std::atoi(argv[++i]), 1, blackjack::max_decks);
+            rules.cards_behind_cut = rules.no_of_decks * 52 / 6;
+        }
+        else if (arg == "--s17")
+            rules.dealer_draw_on_soft_17 = false;
+        else if (arg == "--no-das")
+            rules.allow_double_after_split = false;
+        else if (arg == "--chart" and i + 1 < argc)
+            chart_format = argv[++i];
+        else if (arg == "--batch" and i + 1 < argc)
+            batch_input = argv[++i];
+        else if (arg == "--format" and i + 1 < argc)
+            batch_format = argv[++i];
+        else if (arg == "--output" and i + 1 < argc)
+            output = argv[++i];
+        else if (arg == "--simulate" and i + 1 < argc)
+            simulate_rounds = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" and i + 1 < argc)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--epsilon" and i + 1 < argc)
+            epsilon = std::max(0.0, std::strtod(argv[++i], nullptr));
+        else if (arg == "--budget" and i + 1 < argc)
+            budget_ms = std::max(0.0, std::strtod(argv[++i], nullptr));
+        else if (arg == "--snapshot-load" and i + 1 < argc)
+            snapshot_load = argv[++i];
+        else if (arg == "--snapshot-save" and i + 1 < argc)
+            snapshot_save = argv[++i];
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--threads N] [--engine exact|infinite|eor|anytime]"
+                         " [--decks N] [--s17] [--no-das]"
+                         " [--chart csv|json [--output FILE]]"
+                         " [--batch FILE|- [--format jsonl|csv] [--output FILE]]"
+                         " [--simulate ROUNDS [--seed N]]"
+                         " [--epsilon P] [--budget MS]"
+                         " [--snapshot-load FILE] [--snapshot-save FILE]\n";
+            return 1;
+        }
+    }
+
+    auto opts = blackjack::scenario_options();
+    opts.epsilon = epsilon;
+    opts.time_budget = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::duration<double, std::milli>(budget_ms));
+    if (!snapshot_load.empty())
+    {
+        try
+        {
+            opts.snapshot = blackjack::memo_snapshot::open(snapshot_load, rules, epsilon);
+            std::cerr << "loaded snapshot " << snapshot_load << ": "
+                      << opts.snapshot->player_entries() << " decisions, "
+                      << opts.snapshot->dealer_entries() << " dealer states\n";
+        }
+        catch (blackjack::snapshot_error const &e)
+        {
+            std::cerr << "ignoring snapshot: " << e.what() << '\n';
+        }
+    }
+    auto collect = blackjack::snapshot_builder();
+    auto *collect_ptr = snapshot_save.empty() ? nullptr : &collect;
+    auto save = [&] {
+        if (!collect_ptr)
+            return true;
+        try
+        {
+            collect.write(snapshot_save, rules, epsilon);
+            return true;
+        }
+        catch (blackjack::snapshot_error const &e)
+        {
+            std::cerr << e.what() << '\n';
+            return false;
+        }
+    };
+
+    if (!chart_format.empty())
+    {
+        auto chart = blackjack::with_engine(engine, rules, [&](auto engine_type) {
+            using engine_t = typename decltype(engine_type)::type;
+            return blackjack::make_strategy_chart<engine_t>(rules, threads, opts, collect_ptr);
+        });
+        auto file = std::ofstream();
+        if (!output.empty())
+            file.open(output);
+        auto &os = output.empty() ? std::cout : file;
+        if (chart_format == "json")
+            blackjack::write_json(os, chart);
+        else
+            blackjack::write_csv(os, chart);
+        return os and save() ? 0 : 1;
+    }
+
+    if (!batch_input.empty())
+    {
+        std::ios::sync_with_stdio(false);
+        std::cin.tie(nullptr);
+        auto in_file = std::ifstream();
+        if (batch_input != "-")
+        {
+            in_file.open(batch_input);
+            if (!in_file)
+            {
+                std::cerr << "cannot read " << batch_input << '\n';
+                return 1;
+            }
+        }
+        auto &in = batch_input == "-" ? std::cin : in_file;
+        auto out_file = std::ofstream();
+        if (!output.empty())
+            out_file.open(output);
+        auto &os = output.empty() ? std::cout : out_file;
+        auto format = batch_format == "csv" ? blackjack::batch_format::csv
+                                            : blackjack::batch_format::jsonl;
+        auto totals = blackjack::with_engine(engine, rules, [&](auto engine_type) {
+            using engine_t = typename decltype(engine_type)::type;
+            return blackjack::run_batch<engine_t>(in, os, rules, format, threads, opts, collect_ptr);
+        });
+        std::cerr << totals.queries << " queries, " << totals.failed << " failed\n";
+        return os and save() ? 0 : 1;
+    }
+
+    if (simulate_rounds)
+    {
+        auto sim = blackjack::simulator(rules, blackjack::strategy_table::basic(rules));
+        std::cout << rules << '\n'
+                  << sim.run(simulate_rounds, threads, seed) << std::endl;
+        return 0;
+    }
+
+    blackjack::dispatch_rules(rules, [&](auto rule_set) {
+        using engine_t = blackjack::specialized_scenario<typename decltype(rule_set)::type>;
+        blackjack::play<engine_t>(rules, opts, collect_ptr);
+    });
 
-    auto accum = blackjack::outcome(0, 0);
-    blackjack::iterate_all(scenario, accum);
+    auto accum = blackjack::with_engine(engine, rules, [&](auto engine_type) {
+        using engine_t = typename decltype(engine_type)::type;
+        return blackjack::iterate_all<engine_t>(rules, threads, &std::cout, 1, opts, collect_ptr);
+    });
 
     std::cout << "overall payoff: " << accum << std::endl;
 
-    return 0;
+    return save() ? 0 : 1;
 }
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "effects_of_removal.hpp"
+#include "scenario.hpp"
+#include "polyfill/cancellation.hpp"
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace blackjack {
+
+/// How far the last evaluation of an anytime_scenario got.
+struct anytime_progress
+{
+    /// searches completed before the deadline, after the approximation
+    std::size_t searches = 0;
+
+    /// epsilon of the last search completed; infinity if none was
+    double epsilon = std::numeric_limits<double>::infinity();
+
+    /// whether the last search completed was the final one, at the
+    /// epsilon of the options the engine was made with
+    bool final = false;
+};
+
+/// Answers within a time budget, with the best results found so far.
+///
+/// An evaluation starts from the effects-of-removal approximation, which
+/// takes microseconds, and then refines it by searching with the exact
+/// engine at falling epsilons: 1e-8, 1e-9 and then the epsilon of the
+/// options (by default zero, an exact search). Coarser searches are not
+/// tried, as they come out less accurate than the approximation. Each
+/// search is cancelled once the deadline passes; the results are those of
+/// the last search that completed, or the approximation's if none did.
+/// Only a search's `error` is a bound: the approximation's is an estimate
+/// that it may exceed, so callers should check progress() before relying on
+/// it (see errors_are_bounds()).
+///
+/// Each epsilon has an engine and memo tables of its own, as entries
+/// searched at one epsilon do not stand for another. They last as long as
+/// the anytime_scenario, and a cancelled search keeps what it memoized, so
+/// asking again for the same decision, or one that shares its states,
+/// gets further in the same budget. The final engine uses the tables and
+/// snapshot of the options; the others make small tables of their own.
+struct anytime_scenario
+{
+    using result_vector = scenario::result_vector;
+
+    /// the epsilons searched before that of the options, coarsest first
+    static constexpr double refinements[] = { 1e-8, 1e-9 };
+
+    anytime_scenario(
+        rules const &r,
+        scenario_options const &opts = scenario_options())
+        : approximation_(r, opts)
+        , budget_(opts.time_budget)
+    {
+        auto coarse_opts = opts;
+        coarse_opts.cancel = &deadline_;
+        coarse_opts.snapshot.reset();
+        coarse_opts.tables.reset();
+        coarse_opts.memo_bytes = opts.memo_bytes / std::size(refinements);
+        for (auto epsilon : refinements)
+            if (epsilon > opts.epsilon)
+            {
+                coarse_opts.epsilon = epsilon;
+                levels_.push_back(std::make_unique<scenario>(r, coarse_opts));
+            }
+
+        auto final_opts = opts;
+        final_opts.cancel = &deadline_;
+        levels_.push_back(std::make_unique<scenario>(r, final_opts));
+    }
+
+    // the engines hold a pointer to deadline_
+    anytime_scenario(anytime_scenario const &) = delete;
+    anytime_scenario &operator=(anytime_scenario const &) = delete;
+
+    /// Like scenario::evaluate(), within the time budget of the options.
+    auto
+    evaluate(
+        shoe const &s,
+        player_hand const &p,
+        dealer_hand const &d,
+        cards const &burn_pile) -> result_vector
+    {
+        return evaluate_until(
+            polyfill::cancellation_token::clock::now() + budget_, s, p, d, burn_pile);
+    }
+
+    /// Evaluates every action available to the player, refining until
+    /// `deadline`. The approximation is returned even if the deadline has
+    /// passed already.
+    auto
+    evaluate_until(
+        polyfill::cancellation_token::clock::time_point deadline,
+        shoe const &s,
+        player_hand const &p,
+        dealer_hand const &d,
+        cards const &burn_pile) -> result_vector
+    {
+        auto results = approximation_.evaluate(s, p, d, burn_pile);
+        progress_ = anytime_progress();
+        deadline_.reset();
+        deadline_.cancel_at(deadline);
+        for (auto &level : levels_)
+        {
+            try
+            {
+                results = level->evaluate(s, p, d, burn_pile);
+            }
+            catch (polyfill::operation_cancelled const &)
+            {
+                break;
+            }
+            ++progress_.searches;
+            progress_.epsilon = level->epsilon_;
+            progress_.final = level == levels_.back();
+        }
+        deadline_.reset();
+        return results;
+    }
+
+    auto
+    run(
+        shoe const &s,
+        player_hand const &p,
+        dealer_hand const &d,
+        cards const &burn_pile) -> scenario_result
+    {
+        return scenario::best_of(evaluate(s, p, d, burn_pile));
+    }
+
+    /// How far the last evaluation got.
+    auto
+    progress() const -> anytime_progress
+    { return progress_; }
+
+    eor_scenario approximation_;
+    std::chrono::nanoseconds budget_;
+    polyfill::cancellation_token deadline_;
+    std::vector<std::unique_ptr<scenario>> levels_;
+    anytime_progress progress_;
+};
+
+/// The progress of `engine`'s last evaluation, for an engine that answers
+/// within a time budget; none for the others.
+template<class Engine>
+auto
+last_progress(Engine const &engine) -> std::optional<anytime_progress>
+{
+    if constexpr (requires { engine.progress(); })
+        return engine.progress();
+    else
+        return std::nullopt;
+}
+
+/// Whether the `error` of the results of `engine`'s last evaluation bounds
+/// how far they are from exact, or only estimates it. Engines that estimate
+/// say so with a static errors_are_bounds member.
+template<class Engine>
+auto
+errors_are_bounds(Engine const &engine) -> bool
+{
+    if (auto progress = last_progress(engine))
+        return progress->searches > 0;
+    if constexpr (requires { Engine::errors_are_bounds; })
+        return Engine::errors_are_bounds;
+    else
+        return true;
+}
+
+} // namespace blackjack
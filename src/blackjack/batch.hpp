@@ -0,0 +1,651 @@
+#pragma once
+
+#include "anytime.hpp"
+#include "scenario.hpp"
+#include "strategy_chart.hpp"
+#include "polyfill/parallel_for.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace blackjack {
+
+/// A batch query line that cannot be evaluated; the message says why.
+struct query_error
+    : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+/// One decision for the batch mode to evaluate.
+struct batch_query
+{
+    rules r;
+    shoe s;
+    cards burn_pile;
+    player_hand player;
+    dealer_hand dealer;
+};
+
+namespace detail {
+
+inline auto
+parse_cards(
+    std::string_view text,
+    std::string_view key) -> cards
+{
+    auto result = cards();
+    for (auto ch : text)
+    {
+        auto c = from_char(ch);
+        if (!c)
+            throw query_error(std::string(key) + ": '" + ch + "' is not a card");
+        if (result[*c] == max_rank_count)
+            throw query_error(std::string(key) + ": too many cards");
+        result += *c;
+    }
+    return result;
+}
+
+inline auto
+parse_int(
+    std::string_view text,
+    std::string_view key) -> int
+{
+    auto value = 0;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() or end != text.data() + text.size() or value < 0)
+        throw query_error(std::string(key) + ": '" + std::string(text) + "' is not a count");
+    return value;
+}
+
+inline auto
+parse_flag(
+    std::string_view text,
+    std::string_view key) -> bool
+{
+    if (text == "1" or text == "yes" or text == "true")
+        return true;
+    if (text == "0" or text == "no" or text == "false")
+        return false;
+    throw query_error(std::string(key) + ": '" + std::string(text) + "' is not 0 or 1");
+}
+
+} // namespace detail
+
+/// Parses a query line of whitespace-separated key=value fields:
+///
+///     player=T6    the player's cards (required, two or more)
+///     dealer=9     the dealer's up-card (required)
+///     decks=N      decks in the shoe when it was fresh
+///     cut=N        cards behind the cut card; no more than are left in
+///                  the shoe
+///     shoe=N,...   the counts of 2 to 9, T and A left in the shoe; by
+///                  default a fresh shoe less the player's, dealer's and
+///                  burnt cards
+///     burn=CARDS   the burn pile (default empty)
+///     h17=0|1      whether the dealer draws on soft 17
+///     das=0|1      whether doubling after a split is allowed
+///     split=0|1    whether the player's hand came from a split
+///
+/// Rules not given are taken from `defaults`; giving decks but not cut puts
+/// the cut a sixth of the way from the back, as the command line does.
+/// Throws query_error for a line that does not describe a decision.
+inline auto
+parse_query(
+    std::string_view line,
+    rules const &defaults) -> batch_query
+{
+    auto q = batch_query { defaults, shoe(), cards(), player_hand(), dealer_hand() };
+    auto have_player = false;
+    auto have_dealer = false;
+    auto have_cut = false;
+    auto have_decks = false;
+    auto split = false;
+    auto counts = std::string_view();
+
+    while (!line.empty())
+    {
+        auto start = line.find_first_not_of(" \t\r");
+        if (start == line.npos)
+            break;
+        line.remove_prefix(start);
+        auto field = line.substr(0, line.find_first_of(" \t\r"));
+        line.remove_prefix(field.size());
+
+        auto eq = field.find('=');
+        if (eq == field.npos)
+            throw query_error("'" + std::string(field) + "' is not key=value");
+        auto key = field.substr(0, eq);
+        auto value = field.substr(eq + 1);
+        if (key == "player")
+        {
+            static_cast<cards &>(q.player) = detail::parse_cards(value, key);
+            have_player = true;
+        }
+        else if (key == "dealer")
+        {
+            static_cast<cards &>(q.dealer) = detail::parse_cards(value, key);
+            have_dealer = true;
+        }
+        else if (key == "burn")
+            q.burn_pile = detail::parse_cards(value, key);
+        else if (key == "shoe")
+            counts = value;
+        else if (key == "decks")
+        {
+            q.r.no_of_decks = detail::parse_int(value, key);
+            have_decks = true;
+        }
+        else if (key == "cut")
+        {
+            q.r.cards_behind_cut = detail::parse_int(value, key);
+            have_cut = true;
+        }
+        else if (key == "h17")
+            q.r.dealer_draw_on_soft_17 = detail::parse_flag(value, key);
+        else if (key == "das")
+            q.r.allow_double_after_split = detail::parse_flag(value, key);
+        else if (key == "split")
+            split = detail::parse_flag(value, key);
+        else
+            throw query_error("unknown key '" + std::string(key) + "'");
+    }
+
+    if (!have_player or !have_dealer)
+        throw query_error("player= and dealer= are required");
+    if (q.player.count() < 2)
+        throw query_error("player: a hand has at least two cards");
+    if (score(q.player).bust())
+        throw query_error("player: the hand is bust");
+    if (q.dealer.count() != 1)
+        throw query_error("dealer: give the up-card only");
+    if (q.r.no_of_decks < 1 or q.r.no_of_decks > max_decks)
+        throw query_error("decks: from 1 to " + std::to_string(max_decks));
+    if (have_decks and not have_cut)
+        q.r.cards_behind_cut = q.r.no_of_decks * 52 / 6;
+    // the memo keys hold the cut in cut_bits
+    if (q.r.cards_behind_cut >= 1 << cut_bits)
+        throw query_error("cut: at most " + std::to_string((1 << cut_bits) - 1));
+    q.player.set_after_split(split);
+
+    q.s = shoe(q.r.no_of_decks, q.r.cards_behind_cut);
+    if (counts.empty())
+    {
+        auto dealt = cards();
+        dealt += q.player;
+        dealt += q.dealer;
+        dealt += q.burn_pile;
+        for (auto c : all_card_faces())
+        {
+            if (dealt[c] > q.s[c])
+                throw query_error("more cards dealt than the shoe holds");
+            q.s.adjust(c, -dealt[c]);
+        }
+    }
+    else
+    {
+        q.s.clear();
+        for (auto c : all_card_faces())
+        {
+            auto n = counts.substr(0, counts.find(','));
+            counts.remove_prefix(std::min(counts.size(), n.size() + 1));
+            if (n.empty())
+                throw query_error("shoe: give ten counts, 2 to 9, T and A");
+            auto count = detail::parse_int(n, "shoe");
+            if (count + q.burn_pile[c] > max_rank_count)
+                throw query_error("shoe: at most " + std::to_string(max_rank_count) +
+                                  " of a rank with the burn pile");
+            q.s.adjust(c, count);
+        }
+        if (!counts.empty())
+            throw query_error("shoe: give ten counts, 2 to 9, T and A");
+    }
+    if (q.s.count() == 0)
+        throw query_error("shoe: no cards left");
+    if (q.s.cards_behind_cut > q.s.count())
+        throw query_error("cut: " + std::to_string(q.s.cards_behind_cut) +
+                          " cards behind the cut, but only " + std::to_string(q.s.count()) +
+                          " left in the shoe");
+    return q;
+}
+
+enum class batch_format
+{
+    jsonl,
+    csv
+};
+
+/// Queries read and failed by run_batch.
+struct batch_totals
+{
+    std::size_t queries = 0;
+    std::size_t failed = 0;
+};
+
+namespace detail {
+
+/// Whether every value of `results` is a number a record can hold.
+inline auto
+all_finite(scenario::result_vector const &results) -> bool
+{
+    return std::all_of(results.begin(), results.end(), [](scenario_result const &r) {
+        return std::isfinite(r.pnl()) and std::isfinite(r.error);
+    });
+}
+
+inline void
+append_number(
+    std::string &out,
+    double value)
+{
+    char buffer[32];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, end);
+}
+
+inline void
+append_quoted(
+    std::string &out,
+    std::string_view text,
+    batch_format format)
+{
+    out += '"';
+    for (auto ch : text)
+    {
+        if (ch == '"')
+            out += format == batch_format::csv ? "\"\"" : "\\\"";
+        else if (ch == '\\' and format == batch_format::jsonl)
+            out += "\\\\";
+        else if (static_cast<unsigned char>(ch) < 0x20)
+            out += ' ';
+        else
+            out += ch;
+    }
+    out += '"';
+}
+
+/// The columns of the CSV records beyond those every engine has.
+struct record_columns
+{
+    /// the errors may be estimates rather than bounds, so an error_kind
+    /// column follows the error
+    bool error_kind = false;
+
+    /// the engine answers within a time budget, so how far it got follows
+    bool progress = false;
+
+    template<class Engine>
+    static auto
+    of() -> record_columns
+    {
+        auto result = record_columns();
+        result.progress = requires(Engine const &e) { e.progress(); };
+        if constexpr (requires { Engine::errors_are_bounds; })
+            result.error_kind = !Engine::errors_are_bounds;
+        result.error_kind = result.error_kind or result.progress;
+        return result;
+    }
+};
+
+/// How the results of a record were found.
+struct record_provenance
+{
+    /// whether their errors are bounds rather than estimates
+    bool bounds = true;
+
+    /// how far an engine with a time budget got
+    std::optional<anytime_progress> progress;
+};
+
+/// Appends the record for the query on `line`: its results, or `failure`.
+inline void
+append_record(
+    std::string &out,
+    batch_format format,
+    record_columns const &columns,
+    std::size_t line,
+    batch_query const *q,
+    scenario::result_vector const &results,
+    record_provenance const &how,
+    std::string_view failure)
+{
+    auto best = results.empty() ? nullptr : &results[0];
+    for (auto &&r : results)
+        if (r.pnl() > best->pnl())
+            best = &r;
+    auto error = 0.0;
+    for (auto &&r : results)
+        error = std::max(error, r.error);
+
+    if (format == batch_format::csv)
+    {
+        out += std::to_string(line);
+        out += ',';
+        if (q)
+        {
+            out += to_string(q->player);
+            out += ',';
+            out += to_string(q->dealer);
+        }
+        else
+            out += ',';
+        out += ',';
+        if (best)
+            out += chart_action_name(best->action);
+        for (auto pa : chart_actions)
+        {
+            out += ',';
+            for (auto &&r : results)
+                if (r.action == pa)
+                    append_number(out, r.pnl());
+        }
+        out += ',';
+        if (error > 0)
+            append_number(out, error);
+        if (columns.error_kind)
+        {
+            out += ',';
+            if (error > 0)
+                out += how.bounds ? "bound" : "estimate";
+        }
+        if (columns.progress)
+        {
+            out += ',';
+            if (how.progress)
+            {
+                out += std::to_string(how.progress->searches);
+                out += ',';
+                if (how.progress->searches)
+                    append_number(out, how.progress->epsilon);
+                out += ',';
+                out += how.progress->final ? '1' : '0';
+            }
+            else
+                out += ",,";
+        }
+        out += ',';
+        if (!failure.empty())
+            append_quoted(out, failure, format);
+        out += '\n';
+        return;
+    }
+
+    out += "{\"line\":";
+    out += std::to_string(line);
+    if (!failure.empty())
+    {
+        out += ",\"failure\":";
+        append_quoted(out, failure, format);
+        out += "}\n";
+        return;
+    }
+    out += ",\"player\":\"";
+    out += to_string(q->player);
+    out += "\",\"dealer\":\"";
+    out += to_string(q->dealer);
+    out += "\",\"best\":\"";
+    out += chart_action_name(best->action);
+    out += "\",\"ev\":{";
+    auto sep = "";
+    for (auto pa : chart_actions)
+        for (auto &&r : results)
+            if (r.action == pa)
+            {
+                out += sep;
+                out += '"';
+                out += chart_action_name(pa);
+                out += "\":";
+                append_number(out, r.pnl());
+                sep = ",";
+            }
+    out += '}';
+    if (error > 0)
+    {
+        out += how.bounds ? ",\"error_bound\":" : ",\"error_estimate\":";
+        append_number(out, error);
+    }
+    if (how.progress)
+    {
+        out += ",\"searches\":";
+        out += std::to_string(how.progress->searches);
+        out += ",\"epsilon\":";
+        if (how.progress->searches)
+            append_number(out, how.progress->epsilon);
+        else
+            out += "null";
+        out += ",\"final\":";
+        out += how.progress->final ? "true" : "false";
+    }
+    out += "}\n";
+}
+
+/// A worker's engines, one per variant of the rules the engines depend on
+/// (soft 17 and double after split), each made on first use. An exact
+/// Engine is specialized for its variant's static_rules.
+template<class Engine>
+struct batch_worker
+{
+    static auto
+    variant(rules const &r) -> std::size_t
+    {
+        return std::size_t(r.allow_double_after_split) +
+               2 * std::size_t(r.dealer_draw_on_soft_17);
+    }
+
+    template<class E>
+    struct slot
+    {
+        slot(
+            rules const &r,
+            scenario_options const &opts)
+            : r(r)
+            , engine(this->r, opts)
+        {}
+
+        rules r;
+        E engine;
+    };
+
+    using variant_tables = std::array<std::shared_ptr<scenario_tables>, 4>;
+
+    template<bool H17, bool DAS>
+    using slot_ptr = std::unique_ptr<slot<with_rule_set_t<Engine, static_rules<H17, DAS>>>>;
+
+    /// Calls f with the engine for `r`, which uses the memo tables of its
+    /// variant, shared by all workers. A snapshot in `opts` was built for
+    /// the rules `defaults`, so only that variant's engine consults it.
+    template<class F>
+    auto
+    with_engine_for(
+        rules const &r,
+        rules const &defaults,
+        scenario_options const &opts,
+        variant_tables const &tables,
+        F &&f)
+    {
+        return with_slot(variant(r), [&](auto &s) {
+            using slot_type = typename std::remove_reference_t<decltype(s)>::element_type;
+            if (!s)
+            {
+                auto engine_opts = opts;
+                engine_opts.tables = tables[variant(r)];
+                if (variant(r) != variant(defaults))
+                    engine_opts.snapshot.reset();
+                s = std::make_unique<slot_type>(r, engine_opts);
+            }
+            return f(s->engine);
+        });
+    }
+
+    /// Calls f with the slot of variant `v`, made or not.
+    template<class F>
+    auto
+    with_slot(
+        std::size_t v,
+        F &&f)
+    {
+        switch (v)
+        {
+        case 0: return f(std::get<0>(slots));
+        case 1: return f(std::get<1>(slots));
+        case 2: return f(std::get<2>(slots));
+        default: return f(std::get<3>(slots));
+        }
+    }
+
+    std::tuple<
+        slot_ptr<false, false>,
+        slot_ptr<false, true>,
+        slot_ptr<true, false>,
+        slot_ptr<true, true>> slots;
+};
+
+} // namespace detail
+
+/// Reads query lines (see parse_query) from `in` and writes one record per
+/// query to `out`, in input order, as JSON lines or CSV with a header.
+/// Blank lines and lines starting with '#' are skipped; a line that fails
+/// to parse, or whose evaluation does not give finite values, gets a record
+/// with the reason, and the batch goes on.
+///
+/// A record's largest error is given as an error_bound, or as an
+/// error_estimate where the engine only estimates it: always for the
+/// effects-of-removal engine, and for the anytime engine when no search
+/// finished in time. Records of the anytime engine also give its
+/// anytime_progress: the searches finished, the epsilon of the last (null
+/// if none) and whether it was the final one. In CSV, such engines get the
+/// columns error and error_kind in place of error_bound, and the anytime
+/// engine the columns searches, epsilon and final.
+///
+/// Lines are taken `chunk` at a time. Each chunk is parsed, evaluated and
+/// formatted on `threads` workers, each with its own Engine, and written
+/// out with one call before the next chunk is read, so results stream
+/// while memory stays bounded. The workers' engines, and the memo tables
+/// they share per rules variant, last for the whole batch. Each variant's
+/// tables get an equal share of `opts.memo_bytes`, except that the
+/// `defaults` variant uses the tables in `opts`, if any. Short of an engine with a
+/// time budget, the records are the same for any thread count, as with
+/// iterate_all(). If `collect` is given, the
+/// memo tables of the `defaults` variant are added to it at the end, as a
+/// snapshot is only valid for one rule set.
+template<class Engine = scenario>
+auto
+run_batch(
+    std::istream &in,
+    std::ostream &out,
+    rules const &defaults,
+    batch_format format,
+    std::size_t threads,
+    scenario_options const &opts = scenario_options(),
+    snapshot_builder *collect = nullptr,
+    std::size_t chunk = 256) -> batch_totals
+{
+    using worker = detail::batch_worker<Engine>;
+    threads = std::max<std::size_t>(1, threads);
+    auto workers = std::vector<worker>(threads);
+    // the variants split memo_bytes, so that together they stay within it
+    auto tables = typename worker::variant_tables();
+    if (opts.tables)
+        tables[worker::variant(defaults)] = opts.tables;
+    for (auto &t : tables)
+        if (!t)
+            t = std::make_shared<scenario_tables>(opts.memo_bytes / std::size(tables));
+
+    auto const columns = detail::record_columns::of<Engine>();
+    if (format == batch_format::csv)
+    {
+        out << "line,player,dealer,best,ev_stick,ev_hit,ev_double,ev_split,";
+        out << (columns.error_kind ? "error,error_kind," : "error_bound,");
+        if (columns.progress)
+            out << "searches,epsilon,final,";
+        out << "failure\n";
+    }
+
+    auto totals = batch_totals();
+    auto lines = std::vector<std::string>(chunk);
+    auto numbers = std::vector<std::size_t>(chunk);
+    auto records = std::vector<std::string>(chunk);
+    auto line_no = std::size_t(0);
+    auto text = std::string();
+    while (in)
+    {
+        auto n = std::size_t(0);
+        while (n < chunk and std::getline(in, text))
+        {
+            ++line_no;
+            auto start = text.find_first_not_of(" \t\r");
+            if (start == text.npos or text[start] == '#')
+                continue;
+            std::swap(lines[n], text);
+            numbers[n] = line_no;
+            ++n;
+        }
+
+        auto failed = std::vector<char>(n);
+        polyfill::parallel_for(n, threads, [&](
+            std::size_t w,
+            std::size_t i) {
+            auto &record = records[i];
+            record.clear();
+            try
+            {
+                auto q = parse_query(lines[i], defaults);
+                workers[w].with_engine_for(q.r, defaults, opts, tables, [&](auto &engine) {
+                    auto results = engine.evaluate(q.s, q.player, q.dealer, q.burn_pile);
+                    if (!detail::all_finite(results))
+                        throw query_error("the evaluation did not give a finite value");
+                    auto how = detail::record_provenance { errors_are_bounds(engine),
+                                                           last_progress(engine) };
+                    detail::append_record(record, format, columns, numbers[i], &q, results,
+                                          how, {});
+                });
+            }
+            catch (query_error const &e)
+            {
+                detail::append_record(record, format, columns, numbers[i], nullptr, {}, {},
+                                      e.what());
+                failed[i] = 1;
+            }
+        });
+
+        auto block = std::string();
+        for (std::size_t i = 0 ; i < n ; ++i)
+        {
+            block += records[i];
+            totals.failed += failed[i];
+        }
+        out.write(block.data(), std::streamsize(block.size()));
+        out.flush();
+        totals.queries += n;
+    }
+
+    // the variant's engines share their tables, so one of them has every
+    // entry
+    if (collect)
+        for (auto &w : workers)
+        {
+            auto added = w.with_slot(worker::variant(defaults), [&](auto &s) {
+                if (s)
+                    collect->add(s->engine);
+                return bool(s);
+            });
+            if (added)
+                break;
+        }
+    return totals;
+}
+
+} // namespace blackjack
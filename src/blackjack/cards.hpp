@@ -1,8 +1,11 @@
 #pragma once
 
 #include <array>
+#include <cassert>
+#include <cstdint>
 #include <boost/functional/hash.hpp>
 #include <numeric>
+#include <optional>
 
 namespace blackjack {
 enum card_scale
@@ -38,6 +41,28 @@ inline char to_char(card_scale card)
     return '?';
 }
 
+/// The rank written as `c`, as by to_char; lower case letters and the
+/// face cards J, Q and K are accepted too.
+inline auto
+from_char(char c) -> std::optional<card_scale>
+{
+    switch (c)
+    {
+    case '2':return card_scale::two;
+    case '3':return card_scale::three;
+    case '4':return card_scale::four;
+    case '5':return card_scale::five;
+    case '6':return card_scale::six;
+    case '7':return card_scale::seven;
+    case '8':return card_scale::eight;
+    case '9':return card_scale::nine;
+    case 'T': case 't': case 'J': case 'j': case 'Q': case 'q': case 'K': case 'k':
+        return card_scale::ten;
+    case 'A': case 'a':return card_scale::ace;
+    }
+    return std::nullopt;
+}
+
 inline auto
 operator<<(
     std::ostream &os,
@@ -60,6 +85,13 @@ to_card_scale(std::ptrdiff_t scale) -> card_scale
 
 constexpr int nof_card_scales = 10;
 
+/// Value a card adds to a hand's hard total (aces count one).
+constexpr auto
+hard_value(card_scale c) -> int
+{
+    return c == card_scale::ace ? 1 : c == card_scale::ten ? 10 : int(c) + 2;
+}
+
 struct all_card_faces
 {
     struct iterator
@@ -70,23 +102,23 @@ struct all_card_faces
         using pointer = card_scale *;
         using difference_type = std::ptrdiff_t;
 
-        iterator(int i = nof_card_scales) : i_(i)
+        constexpr iterator(int i = nof_card_scales) : i_(i)
         {}
 
-        auto
+        constexpr auto
         operator*() const -> value_type
         {
             return to_card_scale(i_);
         }
 
-        iterator &
+        constexpr iterator &
         operator++()
         {
             ++i_;
             return *this;
         }
 
-        iterator
+        constexpr iterator
         operator++(int)
         {
             auto result = *this;
@@ -94,11 +126,11 @@ struct all_card_faces
             return result;
         }
 
-        bool
+        constexpr bool
         operator==(iterator const &other) const
         { return i_ == other.i_; }
 
-        bool
+        constexpr bool
         operator!=(iterator const &other) const
         { return not(*this == other); }
 
@@ -106,19 +138,28 @@ struct all_card_faces
         int i_;
     };
 
-    iterator
+    constexpr iterator
     begin() const
     { return iterator(0); }
 
-    iterator
+    constexpr iterator
     end() const
     { return iterator(nof_card_scales); }
 
 };
 
+/// The most cards of one rank that a `cards` can hold, so that a shoe of
+/// up to max_decks (see shoe.hpp) fits.
+constexpr int max_rank_count = 255;
+
+/// A multiset of cards. The counts are stored a byte per rank and the
+/// totals in 16 bits, as the recursion copies shoes, hands and burn piles
+/// at every step; adjust() asserts that they stay in range.
 struct cards
 {
-    using store_type = std::array<int, nof_card_scales>;
+    using count_type = std::uint8_t;
+    using total_type = std::uint16_t;
+    using store_type = std::array<count_type, nof_card_scales>;
     using const_iterator = store_type::const_iterator;
     using value_type = store_type::value_type;
 
@@ -158,7 +199,7 @@ struct cards
 
     bool empty() const { return count() == 0; }
 
-    int const &
+    int
     operator[](card_scale scale) const
     {
         return store_[to_index(scale)];
@@ -182,8 +223,11 @@ struct cards
         card_scale cs,
         int n = 1)
     {
-        store_[to_index(cs)] += n;
-        count_ += n;
+        auto &stored = store_[to_index(cs)];
+        assert(stored + n >= 0 and stored + n <= max_rank_count);
+        stored = count_type(stored + n);
+        count_ = total_type(count_ + n);
+        hard_ = total_type(hard_ + hard_value(cs) * n);
     }
 
     cards &
@@ -223,8 +267,16 @@ struct cards
     void clear()
     {
         std::fill(store_.begin(), store_.end(), 0);
+        count_ = 0;
+        hard_ = 0;
     }
 
+    /// The sum of the cards, counting aces as one. Kept up to date by
+    /// adjust(), like count().
+    int
+    hard_total() const
+    { return hard_; }
+
 private:
     friend auto
     operator<<(
@@ -255,7 +307,7 @@ private:
     friend std::size_t
     hash_value(cards const &c)
     {
-        auto op = boost::hash<std::array<int, nof_card_scales>>();
+        auto op = boost::hash<store_type>();
         return op(c.store_);
     }
 
@@ -268,8 +320,9 @@ private:
     }
 
 protected:
-    std::array<int, nof_card_scales> store_;
-    int count_ = 0;
+    store_type store_;
+    total_type count_ = 0;
+    total_type hard_ = 0;
 };
 
 struct draw_probability
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "score.hpp"
+#include "polyfill/percent.hpp"
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <ostream>
+
+namespace blackjack {
+
+/// The ways a dealer's hand can finish.
+enum class dealer_final
+    : std::uint8_t
+{
+    seventeen,
+    eighteen,
+    nineteen,
+    twenty,
+    twenty_one,
+    bust,
+    blackjack
+};
+
+constexpr int nof_dealer_finals = 7;
+
+constexpr inline auto
+to_dealer_final(score const &dealer_score) -> dealer_final
+{
+    if (dealer_score.blackjack())
+        return dealer_final::blackjack;
+    if (dealer_score.bust())
+        return dealer_final::bust;
+    assert(dealer_score.value() >= 17);
+    return static_cast<dealer_final>(dealer_score.value() - 17);
+}
+
+/// A score that compares against player scores the same way as any dealer
+/// hand finishing in `f`.
+constexpr inline auto
+to_score(dealer_final f) -> score
+{
+    switch (f)
+    {
+    case dealer_final::bust: return score(22, false, false);
+    case dealer_final::blackjack: return score(21, false, true);
+    default: return score(17 + static_cast<int>(f), false, false);
+    }
+}
+
+inline auto
+operator<<(
+    std::ostream &os,
+    dealer_final f) -> std::ostream &
+{
+    return os << to_score(f);
+}
+
+/// Probability of each final dealer result from some dealer state. It does
+/// not depend on the player's score, so one distribution serves every
+/// player total facing the same dealer hand and shoe.
+struct dealer_distribution
+{
+    std::array<double, nof_dealer_finals> p {};
+
+    static constexpr auto
+    certain(dealer_final f) -> dealer_distribution
+    {
+        auto result = dealer_distribution();
+        result[f] = 1.0;
+        return result;
+    }
+
+    constexpr double &
+    operator[](dealer_final f)
+    { return p[static_cast<std::size_t>(f)]; }
+
+    constexpr double
+    operator[](dealer_final f) const
+    { return p[static_cast<std::size_t>(f)]; }
+
+    /// the probability covered; below one if unlikely draws were pruned
+    constexpr double
+    total() const
+    {
+        double result = 0.0;
+        for (auto x : p)
+            result += x;
+        return result;
+    }
+
+    constexpr dealer_distribution &
+    operator*=(double prob)
+    {
+        for (auto &x : p)
+            x *= prob;
+        return *this;
+    }
+
+    constexpr dealer_distribution &
+    operator+=(dealer_distribution const &other)
+    {
+        for (std::size_t i = 0 ; i < p.size() ; ++i)
+            p[i] += other.p[i];
+        return *this;
+    }
+
+    friend auto
+    operator<<(
+        std::ostream &os,
+        dealer_distribution const &dd) -> std::ostream &
+    {
+        auto sep = "";
+        for (int i = 0 ; i < nof_dealer_finals ; ++i)
+        {
+            auto f = static_cast<dealer_final>(i);
+            if (dd[f])
+            {
+                os << sep << f << ':' << polyfill::percentage(dd[f]);
+                sep = ", ";
+            }
+        }
+        return os;
+    }
+};
+
+} // namespace blackjack
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "dealer_distribution.hpp"
+#include "dealer_hand.hpp"
+#include "rank_kernels.hpp"
+#include "rules.hpp"
+#include "score.hpp"
+#include "shoe.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace blackjack {
+
+/// Computes the distribution of the dealer's final result bottom-up.
+///
+/// Where the dealer's recursion visits every sequence of draws, this works
+/// on the multiset of cards drawn so far. That multiset fixes the dealer's
+/// total, and also the composition of the shoe, since a reshuffle at the
+/// cut card always happens after the same number of draws and only adds
+/// the burn pile. States are processed a layer (one more card drawn) at a
+/// time; each hitting state hands its probability on to its successors, so
+/// sequences that only differ in order are merged rather than expanded
+/// again. The result is the same as dealers_turn_impl's, up to rounding.
+///
+/// With a nonzero `epsilon`, states whose probability falls below it are
+/// dropped after merging, so the distribution's total falls short of one
+/// by the probability left unaccounted for.
+///
+/// The buffers are kept between calls, so an engine holds one instance.
+class dealer_dp
+{
+public:
+    auto
+    operator()(
+        rules const &r,
+        shoe const &s,
+        dealer_hand const &d,
+        cards const &burn_pile,
+        double epsilon = 0.0) -> dealer_distribution
+    {
+        return (*this)(runtime_rules(r), s, d, burn_pile, epsilon);
+    }
+
+    /// As above, for the rules of `rule_set`, a runtime_rules or
+    /// static_rules.
+    template<class RuleSet>
+    auto
+    operator()(
+        RuleSet const &rule_set,
+        shoe const &s,
+        dealer_hand const &d,
+        cards const &burn_pile,
+        double epsilon = 0.0) -> dealer_distribution
+    {
+        auto result = dealer_distribution();
+
+        // the shoe is reshuffled before the draw that finds it at the cut
+        auto const reshuffle_at = s.count() - s.cards_behind_cut;
+
+        current_.clear();
+        current_.push_back(state { 0, 1.0, d.hard_total(), d[card_scale::ace] != 0 });
+        for (int drawn = 0 ; !current_.empty() ; ++drawn)
+        {
+            auto const merged = reshuffle_at >= 0 and drawn >= reshuffle_at;
+            auto const remaining = s.count() - drawn + (merged ? burn_pile.count() : 0);
+            auto available = rank_vector();
+            for (auto c : all_card_faces())
+                available[c] = double(s[c] + (merged ? burn_pile[c] : 0));
+            auto const inverse = 1.0 / double(remaining);
+
+            // states that stand are done; the rest draw, the probability of
+            // each card for all of them coming from one kernel call
+            hitting_.clear();
+            keys_.clear();
+            scales_.clear();
+            for (auto const &st : current_)
+            {
+                auto dealer_score = st.to_score(d.count() + drawn);
+                if (rule_set.get().select_dealer_action(dealer_score) == dealer_action::stand)
+                {
+                    result[to_dealer_final(dealer_score)] += st.probability;
+                    continue;
+                }
+                hitting_.push_back(st);
+                keys_.push_back(st.key);
+                scales_.push_back(st.probability * inverse);
+            }
+
+            // with no card left to draw, the hitting states end here, as in
+            // the dealer's recursion, and are left out of the distribution
+            // (their scales are infinite, so must not reach the kernel)
+            if (remaining == 0)
+                break;
+            nodes_ += hitting_.size();
+            weights_.resize(hitting_.size());
+            kernels_.remaining_weights(
+                available, keys_.data(), scales_.data(), hitting_.size(), weights_.data());
+
+            next_.clear();
+            for (std::size_t i = 0 ; i < hitting_.size() ; ++i)
+            {
+                auto const &st = hitting_[i];
+                for (auto c : all_card_faces())
+                {
+                    if (weights_[i][c] <= 0)
+                        continue;
+                    next_.push_back(state {
+                        st.key + (std::uint64_t(1) << (count_bits * to_index(c))),
+                        weights_[i][c],
+                        st.hard + hard_value(c),
+                        st.ace or c == card_scale::ace });
+                }
+            }
+
+            merge_duplicates();
+            if (epsilon > 0)
+                prune(epsilon);
+            std::swap(current_, next_);
+        }
+        return result;
+    }
+
+    /// dealer states expanded so far
+    std::uint64_t
+    nodes() const
+    { return nodes_; }
+
+    /// dealer states dropped for being less likely than epsilon
+    std::uint64_t
+    pruned() const
+    { return pruned_; }
+
+private:
+    /// Bits per rank in a state's key. The dealer stands by a hard 17, so
+    /// no rank is drawn more than 16 times.
+    static constexpr unsigned count_bits = 5;
+    static_assert(count_bits == rank_kernels::packed_bits);
+
+    struct state
+    {
+        std::uint64_t key; // cards drawn, count_bits per rank
+        double probability;
+        int hard;
+        bool ace;
+
+        int
+        drawn(card_scale c) const
+        { return int(key >> (count_bits * to_index(c))) & ((1 << count_bits) - 1); }
+
+        auto
+        to_score(int nof_cards) const -> score
+        {
+            if (nof_cards == 2 and ace and hard == 11)
+                return score(21, false, true);
+            return hard_score(hard, ace);
+        }
+    };
+
+    /// Sums the probabilities of states reached by more than one order of
+    /// draws, leaving one state per multiset in next_.
+    void
+    merge_duplicates()
+    {
+        std::sort(next_.begin(), next_.end(), [](
+            state const &a,
+            state const &b) {
+            return a.key < b.key;
+        });
+        auto out = next_.begin();
+        for (auto in = next_.begin() ; in != next_.end() ; ++in)
+        {
+            if (out != next_.begin() and std::prev(out)->key == in->key)
+                std::prev(out)->probability += in->probability;
+            else
+                *out++ = *in;
+        }
+        next_.erase(out, next_.end());
+    }
+
+    void
+    prune(double epsilon)
+    {
+        auto before = next_.size();
+        next_.erase(std::remove_if(next_.begin(), next_.end(), [epsilon](state const &st) {
+            return st.probability < epsilon;
+        }), next_.end());
+        pruned_ += before - next_.size();
+    }
+
+    rank_kernels const &kernels_ = rank_kernels::get();
+    std::vector<state> current_;
+    std::vector<state> next_;
+    std::vector<state> hitting_;
+    std::vector<std::uint64_t> keys_;
+    std::vector<double> scales_;
+    std::vector<rank_vector> weights_;
+    std::uint64_t nodes_ = 0;
+    std::uint64_t pruned_ = 0;
+};
+
+} // namespace blackjack
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "infinite_deck.hpp"
+#include <cmath>
+#include <memory>
+
+namespace blackjack {
+
+/// Infinite-deck tables for a reference composition, and for that
+/// composition with one card of each rank taken out and put in.
+///
+/// With n the reference counts and N their total, taking out a card of
+/// rank c moves the draw probabilities from p0 = n / N by -u_c / (N - 1),
+/// and putting one in moves them by u_c / (N + 1), where u_c = e_c - p0.
+/// The u_c span every change of composition, since any shift d of the
+/// probabilities (whose components sum to zero) is the sum of d_c * u_c.
+struct eor_tables
+{
+    static constexpr int reference_cards = 52;
+
+    rank_probabilities reference {};
+    infinite_deck_tables base {};
+    std::array<infinite_deck_tables, nof_card_scales> removed {};
+    std::array<infinite_deck_tables, nof_card_scales> added {};
+};
+
+inline auto
+make_eor_tables(rules const &r) -> std::unique_ptr<eor_tables>
+{
+    constexpr auto n = double(eor_tables::reference_cards);
+    auto result = std::make_unique<eor_tables>();
+    result->reference = infinite_deck_probabilities();
+    result->base = make_infinite_deck_tables(r, result->reference);
+    for (auto c : all_card_faces())
+    {
+        auto removed = rank_probabilities();
+        auto added = rank_probabilities();
+        for (auto o : all_card_faces())
+        {
+            auto count = result->reference[to_index(o)] * n;
+            auto own = o == c ? 1.0 : 0.0;
+            removed[to_index(o)] = (count - own) / (n - 1);
+            added[to_index(o)] = (count + own) / (n + 1);
+        }
+        result->removed[to_index(c)] = make_infinite_deck_tables(r, removed);
+        result->added[to_index(c)] = make_infinite_deck_tables(r, added);
+    }
+    return result;
+}
+
+/// Approximate evaluation from effects of removal: the outcome of each
+/// action under the shoe's actual rank probabilities is extrapolated from
+/// infinite-deck outcomes at a full-deck composition, using the change
+/// that removing or adding a single card of each rank makes. A query costs
+/// a few table lookups and dot products whatever the size of the shoe.
+///
+/// Each result carries an error estimate from the curvature seen between
+/// the removed and added tables. It covers the extrapolation only, not the
+/// infinite-deck engine's neglect of the cards drawn during the hand; the
+/// burn pile is ignored as a reshuffle is not modelled either.
+struct eor_scenario
+{
+    /// the errors are estimates, which the true error may exceed
+    static constexpr bool errors_are_bounds = false;
+
+    eor_scenario(
+        rules const &r,
+        scenario_options const & = scenario_options())
+        : rules_(r)
+        , tables_(tables_for(r))
+    {}
+
+    /// Like the infinite-deck tables, these only depend on the soft 17 and
+    /// double after split rules. They take a few milliseconds to build, so
+    /// each variant is built once, the first time it is asked for, and
+    /// shared.
+    static auto
+    tables_for(rules const &r) -> eor_tables const &
+    {
+        if (r.dealer_draw_on_soft_17)
+        {
+            if (r.allow_double_after_split)
+                return variant_tables<true, true>();
+            else
+                return variant_tables<false, true>();
+        }
+        else
+        {
+            if (r.allow_double_after_split)
+                return variant_tables<true, false>();
+            else
+                return variant_tables<false, false>();
+        }
+    }
+
+    template<bool DAS, bool H17>
+    static auto
+    variant_tables() -> eor_tables const &
+    {
+        static auto const tables = make_eor_tables(rules { .allow_double_after_split = DAS,
+                                                           .dealer_draw_on_soft_17 = H17 });
+        return *tables;
+    }
+
+    auto
+    evaluate(
+        shoe const &s,
+        player_hand const &p,
+        dealer_hand const &d,
+        cards const &) const -> scenario::result_vector
+    {
+        auto results = infinite_deck_scenario::evaluate_with(tables_.base, rules_, p, d);
+        if (s.count() == 0)
+            return results;
+
+        // step along u_c that takes the reference probabilities to the shoe's
+        auto step = rank_probabilities();
+        for (auto c : all_card_faces())
+            step[to_index(c)] = s.probability(c) - tables_.reference[to_index(c)];
+
+        constexpr auto n = double(eor_tables::reference_cards);
+        constexpr auto back = 1.0 / (n - 1);
+        constexpr auto ahead = 1.0 / (n + 1);
+
+        auto invested = std::array<double, 4>();
+        auto returned = std::array<double, 4>();
+        auto error = std::array<double, 4>();
+        for (auto c : all_card_faces())
+        {
+            auto removed = infinite_deck_scenario::evaluate_with(
+                tables_.removed[to_index(c)], rules_, p, d);
+            auto added = infinite_deck_scenario::evaluate_with(
+                tables_.added[to_index(c)], rules_, p, d);
+            auto t = step[to_index(c)];
+            for (std::size_t i = 0 ; i < results.size() ; ++i)
+            {
+                auto const &f0 = results[i];
+                auto const &fr = removed[i];
+                auto const &fa = added[i];
+
+                // divided differences over the points -back, 0 and ahead
+                invested[i] += t * (fa.invested - fr.invested) / (ahead + back);
+                returned[i] += t * (fa.returned - fr.returned) / (ahead + back);
+                auto curvature = 2.0 *
+                    (back * fa.pnl() + ahead * fr.pnl() - (back + ahead) * f0.pnl()) /
+                    (back * ahead * (back + ahead));
+                error[i] += std::sqrt(std::abs(curvature)) * std::abs(t);
+            }
+        }
+
+        for (std::size_t i = 0 ; i < results.size() ; ++i)
+        {
+            results[i].invested += invested[i];
+            results[i].returned += returned[i];
+            // bounds t' H t for a semidefinite H from its diagonal alone
+            results[i].error = 0.5 * error[i] * error[i];
+        }
+        return results;
+    }
+
+    auto
+    run(
+        shoe const &s,
+        player_hand const &p,
+        dealer_hand const &d,
+        cards const &burn_pile) -> scenario_result
+    {
+        return scenario::best_of(evaluate(s, p, d, burn_pile));
+    }
+
+    rules const &rules_;
+    eor_tables const &tables_;
+};
+
+} // namespace blackjack
@@ -0,0 +1,280 @@
+#pragma once
+
+#include "scenario.hpp"
+#include <array>
+
+namespace blackjack {
+
+/// Probability of drawing each rank, indexed by to_index(card_scale).
+using rank_probabilities = std::array<double, nof_card_scales>;
+
+/// Draw probabilities of a shoe with infinitely many decks.
+constexpr auto
+infinite_deck_probabilities() -> rank_probabilities
+{
+    auto result = rank_probabilities();
+    for (auto &p : result)
+        p = 1.0 / 13.0;
+    result[to_index(card_scale::ten)] = 4.0 / 13.0;
+    return result;
+}
+
+/// Expected values when every draw has the same rank probabilities,
+/// regardless of which cards have gone before.
+///
+/// Player states are (hard total, holds an ace), which is everything a
+/// decision depends on once the composition no longer changes. All tables
+/// are indexed [up-card][hard total][ace], except split which is indexed
+/// [up-card][pair rank].
+struct infinite_deck_tables
+{
+    static constexpr int nof_totals = 32;
+
+    template<class T>
+    using by_state = std::array<std::array<std::array<T, 2>, nof_totals>, nof_card_scales>;
+
+    bool double_after_split = false;
+    std::array<dealer_distribution, nof_card_scales> dealer {};
+    by_state<outcome> stick {};
+    by_state<outcome> hit {};
+    by_state<outcome> double_down {};
+    by_state<outcome> best {};
+
+    /// hitting, and the best play, for a hand that came from a split
+    by_state<outcome> split_hit {};
+    by_state<outcome> split_best {};
+
+    /// splitting a pair: two hands of one card, each played on as split_best
+    std::array<std::array<outcome, nof_card_scales>, nof_card_scales> split {};
+};
+
+constexpr auto
+make_infinite_deck_tables(
+    rules const &r,
+    rank_probabilities const &prob = infinite_deck_probabilities())
+-> infinite_deck_tables
+{
+    auto result = infinite_deck_tables();
+    result.double_after_split = r.allow_double_after_split;
+
+    // dealer hands of two or more cards, which can no longer be blackjack
+    constexpr int max_dealer_hard = 26;
+    std::array<std::array<dealer_distribution, 2>, max_dealer_hard + 1> dealer {};
+    for (int hard = max_dealer_hard ; hard >= 2 ; --hard)
+        for (int ace = 0 ; ace < 2 ; ++ace)
+        {
+            auto dealer_score = hard_score(hard, ace);
+            auto &dd = dealer[hard][ace];
+            if (r.select_dealer_action(dealer_score) == dealer_action::stand)
+                dd = dealer_distribution::certain(to_dealer_final(dealer_score));
+            else
+                for (auto c : all_card_faces())
+                {
+                    auto next = dealer[hard + hard_value(c)][ace or c == card_scale::ace];
+                    next *= prob[to_index(c)];
+                    dd += next;
+                }
+        }
+
+    for (auto up : all_card_faces())
+    {
+        auto &dd = result.dealer[to_index(up)];
+        for (auto c : all_card_faces())
+        {
+            auto natural = (up == card_scale::ace and c == card_scale::ten) or
+                           (up == card_scale::ten and c == card_scale::ace);
+            auto next = natural
+                        ? dealer_distribution::certain(dealer_final::blackjack)
+                        : dealer[hard_value(up) + hard_value(c)]
+                                [up == card_scale::ace or c == card_scale::ace];
+            next *= prob[to_index(c)];
+            dd += next;
+        }
+    }
+
+    for (auto up : all_card_faces())
+    {
+        auto const &dd = result.dealer[to_index(up)];
+        auto &stick = result.stick[to_index(up)];
+        auto &hit = result.hit[to_index(up)];
+        auto &dbl = result.double_down[to_index(up)];
+        auto &best = result.best[to_index(up)];
+        auto &split_hit = result.split_hit[to_index(up)];
+        auto &split_best = result.split_best[to_index(up)];
+
+        for (int hard = infinite_deck_tables::nof_totals - 1 ; hard >= 2 ; --hard)
+            for (int ace = 0 ; ace < 2 ; ++ace)
+            {
+                auto player_score = hard_score(hard, ace);
+                if (player_score.bust())
+                {
+                    stick[hard][ace] = hit[hard][ace] = dbl[hard][ace] =
+                        best[hard][ace] = split_hit[hard][ace] =
+                        split_best[hard][ace] = outcome(1, 0);
+                    continue;
+                }
+
+                stick[hard][ace] = outcome(1, r.payoff(player_score, dd));
+
+                double invested = 0.0;
+                double returned = 0.0;
+                double doubled = 0.0;
+                double split_invested = 0.0;
+                double split_returned = 0.0;
+                for (auto c : all_card_faces())
+                {
+                    auto p = prob[to_index(c)];
+                    auto next_hard = hard + hard_value(c);
+                    auto next_ace = ace or c == card_scale::ace;
+                    auto const &next = best[next_hard][next_ace];
+                    invested += p * next.invested;
+                    returned += p * next.returned;
+                    doubled += p * stick[next_hard][next_ace].returned;
+                    auto const &split_next = split_best[next_hard][next_ace];
+                    split_invested += p * split_next.invested;
+                    split_returned += p * split_next.returned;
+                }
+                hit[hard][ace] = outcome(invested, returned);
+                dbl[hard][ace] = outcome(1, doubled);
+                dbl[hard][ace].double_down();
+                split_hit[hard][ace] = outcome(split_invested, split_returned);
+
+                auto b = stick[hard][ace];
+                if (hit[hard][ace].pnl() > b.pnl())
+                    b = hit[hard][ace];
+                if (dbl[hard][ace].pnl() > b.pnl())
+                    b = dbl[hard][ace];
+                best[hard][ace] = b;
+
+                auto sb = stick[hard][ace];
+                if (split_hit[hard][ace].pnl() > sb.pnl())
+                    sb = split_hit[hard][ace];
+                if (r.allow_double_after_split and dbl[hard][ace].pnl() > sb.pnl())
+                    sb = dbl[hard][ace];
+                split_best[hard][ace] = sb;
+            }
+
+        for (auto pair : all_card_faces())
+        {
+            double invested = 0.0;
+            double returned = 0.0;
+            for (auto c : all_card_faces())
+            {
+                auto p = prob[to_index(c)];
+                auto const &next = split_best[hard_value(pair) + hard_value(c)]
+                                             [pair == card_scale::ace or c == card_scale::ace];
+                invested += p * next.invested;
+                returned += p * next.returned;
+            }
+            result.split[to_index(up)][to_index(pair)] = outcome(2 * invested, 2 * returned);
+        }
+    }
+
+    return result;
+}
+
+/// Tables for a rule set known at compile time.
+template<rules R>
+inline constexpr auto infinite_deck_tables_v = make_infinite_deck_tables(R);
+
+/// Composition-independent evaluation: every draw comes from an infinite
+/// shoe, so the shoe and burn pile arguments are ignored and each query is
+/// a table lookup.
+struct infinite_deck_scenario
+{
+    infinite_deck_scenario(
+        rules const &r,
+        scenario_options const & = scenario_options())
+        : rules_(r)
+        , tables_(tables_for(r))
+    {}
+
+    /// The tables only depend on the soft 17 and double after split rules,
+    /// so every variant is built by the compiler.
+    static auto
+    tables_for(rules const &r) -> infinite_deck_tables const &
+    {
+        if (r.dealer_draw_on_soft_17)
+        {
+            if (r.allow_double_after_split)
+                return infinite_deck_tables_v<rules { .allow_double_after_split = true,
+                                                      .dealer_draw_on_soft_17 = true }>;
+            else
+                return infinite_deck_tables_v<rules { .allow_double_after_split = false,
+                                                      .dealer_draw_on_soft_17 = true }>;
+        }
+        else
+        {
+            if (r.allow_double_after_split)
+                return infinite_deck_tables_v<rules { .allow_double_after_split = true,
+                                                      .dealer_draw_on_soft_17 = false }>;
+            else
+                return infinite_deck_tables_v<rules { .allow_double_after_split = false,
+                                                      .dealer_draw_on_soft_17 = false }>;
+        }
+    }
+
+    auto
+    evaluate(
+        shoe const &,
+        player_hand const &p,
+        dealer_hand const &d,
+        cards const &) const -> scenario::result_vector
+    {
+        return evaluate_with(tables_, rules_, p, d);
+    }
+
+    /// The outcome of every action allowed by `r`, looked up in `tables`.
+    static auto
+    evaluate_with(
+        infinite_deck_tables const &tables,
+        rules const &r,
+        player_hand const &p,
+        dealer_hand const &d) -> scenario::result_vector
+    {
+        assert(d.count() == 1);
+        auto up = card_scale::two;
+        for (auto c : all_card_faces())
+            if (d[c])
+                up = c;
+
+        auto results = scenario::result_vector();
+        auto player_score = score(p);
+        auto &stick = results.push_back(scenario_result(player_action::stick));
+        if (player_score.blackjack())
+        {
+            stick.update(outcome(1, r.payoff(player_score, tables.dealer[to_index(up)])));
+            return results;
+        }
+
+        auto hard = p.hard_total();
+        auto ace = p[card_scale::ace] != 0;
+        auto const &hit = p.after_split() ? tables.split_hit : tables.hit;
+        stick.update(tables.stick[to_index(up)][hard][ace]);
+        if (r.may_hit(p))
+            results.push_back(scenario_result(player_action::hit))
+                .update(hit[to_index(up)][hard][ace]);
+        if (r.may_double(p))
+            results.push_back(scenario_result(player_action::double_down))
+                .update(tables.double_down[to_index(up)][hard][ace]);
+        if (r.may_split(p))
+            results.push_back(scenario_result(player_action::split))
+                .update(tables.split[to_index(up)][to_index(*p.is_pair())]);
+        return results;
+    }
+
+    auto
+    run(
+        shoe const &s,
+        player_hand const &p,
+        dealer_hand const &d,
+        cards const &burn_pile) -> scenario_result
+    {
+        return scenario::best_of(evaluate(s, p, d, burn_pile));
+    }
+
+    rules const &rules_;
+    infinite_deck_tables const &tables_;
+};
+
+} // namespace blackjack
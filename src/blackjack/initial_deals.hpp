@@ -0,0 +1,101 @@
+#pragma once
+
+#include "scenario.hpp"
+#include "polyfill/parallel_for.hpp"
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace blackjack {
+
+/// One of the nof_card_scales^3 (player, player, dealer up-card) deals.
+struct initial_deal
+{
+    card_scale p1, p2, d;
+
+    static auto
+    from_index(std::size_t i) -> initial_deal
+    {
+        return initial_deal { to_card_scale(i / (nof_card_scales * nof_card_scales)),
+                              to_card_scale(i / nof_card_scales % nof_card_scales),
+                              to_card_scale(i % nof_card_scales) };
+    }
+};
+
+constexpr std::size_t nof_initial_deals =
+    nof_card_scales * nof_card_scales * nof_card_scales;
+
+/// Evaluates every initial deal from a fresh shoe of `decks` decks and
+/// returns the probability-weighted sum of the outcomes.
+///
+/// Deals are spread over `threads` workers, each with its own Engine
+/// (scenario or any type with the same constructor and run()). The workers
+/// share one set of memo tables, those in `opts` if any, so every state is
+/// searched and stored once.
+/// The per-deal outcomes are reduced in deal order after all workers have
+/// finished, and a memo entry does not depend on which worker made it, so
+/// the result is bit-identical for any thread count, pruned or not. If `log`
+/// is given, one line per deal is written to it, also in deal order. If
+/// `collect` is given, the memo tables are added to it at the end.
+template<class Engine = scenario>
+auto
+iterate_all(
+    rules const &r,
+    std::size_t threads,
+    std::ostream *log = nullptr,
+    std::size_t decks = 1,
+    scenario_options const &opts = scenario_options(),
+    snapshot_builder *collect = nullptr) -> outcome
+{
+    auto const sh = shoe(decks);
+    threads = std::max<std::size_t>(1, std::min(threads, nof_initial_deals));
+
+    auto worker_opts = opts;
+    if (!worker_opts.tables)
+        worker_opts.tables = std::make_shared<scenario_tables>(opts.memo_bytes);
+    auto workers = std::vector<std::unique_ptr<Engine>>();
+    for (std::size_t w = 0 ; w < threads ; ++w)
+        workers.push_back(std::make_unique<Engine>(r, worker_opts));
+
+    auto results = std::vector<outcome>(nof_initial_deals);
+    auto reports = std::vector<std::string>(log ? nof_initial_deals : 0);
+
+    polyfill::parallel_for(nof_initial_deals, threads, [&](
+        std::size_t w,
+        std::size_t i) {
+        auto [p1, p2, d] = initial_deal::from_index(i);
+        auto player = player_hand(p1, p2);
+        auto dealer = dealer_hand(d);
+        auto prob_comp = draw_probability(sh);
+        auto prob =
+            prob_comp.update(p1) * prob_comp.update(p2) * prob_comp.update(d);
+        auto s = sh;
+        s -= p1;
+        s -= p2;
+        s -= d;
+        auto result = workers[w]->run(s, player, dealer, cards());
+        if (log)
+        {
+            auto os = std::ostringstream();
+            os << "player has " << player << " vs dealer's " << dealer
+               << " player should " << result << '\n';
+            reports[i] = os.str();
+        }
+        results[i] = result * prob;
+    });
+
+    // the workers share their tables, so one of them has every entry
+    if (collect)
+        collect->add(*workers.front());
+
+    auto accum = outcome(0, 0);
+    for (std::size_t i = 0 ; i < nof_initial_deals ; ++i)
+    {
+        if (log)
+            *log << reports[i];
+        accum += results[i];
+    }
+    return accum;
+}
+
+} // namespace blackjack
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "dealer_distribution.hpp"
+#include "rules.hpp"
+#include "scenario_result.hpp"
+#include "state_key.hpp"
+#include "polyfill/frozen_table.hpp"
+#include "polyfill/mapped_file.hpp"
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace blackjack {
+
+struct snapshot_error
+    : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+/// Identifies everything that changes the value stored under a memo key:
+/// the rules, and the epsilon below which the search was pruned.
+inline auto
+fingerprint(
+    rules const &r,
+    double epsilon = 0.0) -> std::uint64_t
+{
+    auto h = std::uint64_t(memo_layout_version);
+    auto mix = [&h](std::uint64_t v) {
+        h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    };
+    mix(r.allow_double_after_split);
+    mix(r.dealer_draw_on_soft_17);
+    mix(std::uint64_t(r.no_of_decks));
+    mix(std::uint64_t(r.cards_behind_cut));
+    mix(std::bit_cast<std::uint64_t>(epsilon));
+    return h;
+}
+
+/// On-disk layout of a memo snapshot: this header, then the player and
+/// dealer tables as frozen_table images at the given offsets.
+struct snapshot_header
+{
+    static constexpr char expected_magic[8] = { 'B', 'J', 'M', 'E', 'M', 'O', '\0', '\0' };
+    static constexpr std::uint32_t current_version = 1;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t layout;
+    std::uint64_t rules_fingerprint;
+    std::uint32_t player_entry_bytes;
+    std::uint32_t dealer_entry_bytes;
+    std::uint64_t player_offset;
+    std::uint64_t player_capacity;
+    std::uint64_t player_size;
+    std::uint64_t dealer_offset;
+    std::uint64_t dealer_capacity;
+    std::uint64_t dealer_size;
+    std::uint64_t file_bytes;
+};
+
+/// Memo tables persisted by a previous run, mapped read-only. A scenario
+/// consults it after a miss in its own tables.
+class memo_snapshot
+{
+public:
+    using player_table = polyfill::frozen_table<player_state_key, memo_result>;
+    using dealer_table = polyfill::frozen_table<dealer_state_key, dealer_distribution>;
+
+    /// Maps the snapshot at `path`. Throws snapshot_error if the file cannot
+    /// be read, is not a snapshot of this version and layout, or was built
+    /// for different rules or epsilon.
+    static auto
+    open(
+        std::string const &path,
+        rules const &r,
+        double epsilon = 0.0) -> std::shared_ptr<memo_snapshot const>
+    {
+        auto result = std::shared_ptr<memo_snapshot>(new memo_snapshot());
+        try
+        {
+            result->file_ = polyfill::mapped_file(path);
+        }
+        catch (std::system_error const &e)
+        {
+            throw snapshot_error(e.what());
+        }
+
+        auto const &f = result->file_;
+        auto fail = [&](const char *why) {
+            return snapshot_error(path + ": " + why);
+        };
+        if (f.size() < sizeof(snapshot_header))
+            throw fail("too short to be a memo snapshot");
+
+        auto h = snapshot_header();
+        std::memcpy(&h, f.data(), sizeof(h));
+        if (std::memcmp(h.magic, snapshot_header::expected_magic, sizeof(h.magic)) != 0)
+            throw fail("not a memo snapshot");
+        if (h.version != snapshot_header::current_version or h.layout != memo_layout_version)
+            throw fail("snapshot was written by an incompatible version");
+        if (h.player_entry_bytes != sizeof(player_table::entry) or
+            h.dealer_entry_bytes != sizeof(dealer_table::entry))
+            throw fail("snapshot entry layout does not match this build");
+        if (h.rules_fingerprint != fingerprint(r, epsilon))
+            throw fail("snapshot was built for different rules or epsilon");
+
+        auto fits = [&](
+            std::uint64_t offset,
+            std::uint64_t capacity,
+            std::uint64_t bytes) {
+            return offset % 8 == 0 and capacity and (capacity & (capacity - 1)) == 0 and
+                   bytes <= f.size() and offset <= f.size() - bytes;
+        };
+        if (h.file_bytes != f.size() or
+            not fits(h.player_offset, h.player_capacity,
+                     player_table::image_bytes(h.player_capacity)) or
+            not fits(h.dealer_offset, h.dealer_capacity,
+                     dealer_table::image_bytes(h.dealer_capacity)))
+            throw fail("snapshot is truncated or corrupt");
+
+        auto base = static_cast<char const *>(f.data());
+        result->player_ = player_table::view(base + h.player_offset, h.player_capacity, h.player_size);
+        result->dealer_ = dealer_table::view(base + h.dealer_offset, h.dealer_capacity, h.dealer_size);
+        return result;
+    }
+
+    memo_result const *
+    find_player(player_state_key const &key) const
+    { return player_.find(key); }
+
+    dealer_distribution const *
+    find_dealer(dealer_state_key const &key) const
+    { return dealer_.find(key); }
+
+    std::size_t
+    player_entries() const
+    { return player_.size(); }
+
+    std::size_t
+    dealer_entries() const
+    { return dealer_.size(); }
+
+private:
+    memo_snapshot() = default;
+
+    polyfill::mapped_file file_;
+    player_table::view player_;
+    dealer_table::view dealer_;
+};
+
+/// Gathers memo entries from one or more scenarios and writes a snapshot.
+class snapshot_builder
+{
+public:
+    /// Adds every entry cached by `s`. Engines without memo tables add
+    /// nothing.
+    template<class Engine>
+    void
+    add(Engine const &s)
+    {
+        if constexpr (requires { s.player_memo_; s.memo_; })
+        {
+            s.player_memo_.for_each([&](
+                player_state_key const &k,
+                memo_result const &v) {
+                player_.add(k, v);
+            });
+            s.memo_.for_each([&](
+                dealer_state_key const &k,
+                dealer_distribution const &v) {
+                dealer_.add(k, v);
+            });
+        }
+    }
+
+    /// Writes the snapshot for rules `r`, searched with `epsilon`. The file
+    /// is written under a temporary name and renamed into place, so a
+    /// reader never maps a partial snapshot. Throws snapshot_error on
+    /// failure.
+    void
+    write(
+        std::string const &path,
+        rules const &r,
+        double epsilon = 0.0) const
+    {
+        auto player_image = std::vector<char>();
+        auto dealer_image = std::vector<char>();
+        auto player_capacity = player_.capacity();
+        auto dealer_capacity = dealer_.capacity();
+        auto player_size = player_.build(player_image);
+        auto dealer_size = dealer_.build(dealer_image);
+
+        auto align = [](std::uint64_t n) { return (n + 7) / 8 * 8; };
+        auto h = snapshot_header();
+        std::memcpy(h.magic, snapshot_header::expected_magic, sizeof(h.magic));
+        h.version = snapshot_header::current_version;
+        h.layout = memo_layout_version;
+        h.rules_fingerprint = fingerprint(r, epsilon);
+        h.player_entry_bytes = sizeof(memo_snapshot::player_table::entry);
+        h.dealer_entry_bytes = sizeof(memo_snapshot::dealer_table::entry);
+        h.player_offset = align(sizeof(h));
+        h.player_capacity = player_capacity;
+        h.player_size = player_size;
+        h.dealer_offset = align(h.player_offset + player_image.size());
+        h.dealer_capacity = dealer_capacity;
+        h.dealer_size = dealer_size;
+        h.file_bytes = h.dealer_offset + dealer_image.size();
+
+        auto temp = path + ".tmp";
+        {
+            auto os = std::ofstream(temp, std::ios::binary | std::ios::trunc);
+            auto pad = [&](std::uint64_t to) {
+                while (std::uint64_t(os.tellp()) < to)
+                    os.put('\0');
+            };
+            os.write(reinterpret_cast<char const *>(&h), sizeof(h));
+            pad(h.player_offset);
+            os.write(player_image.data(), std::streamsize(player_image.size()));
+            pad(h.dealer_offset);
+            os.write(dealer_image.data(), std::streamsize(dealer_image.size()));
+            if (!os.flush())
+            {
+                std::remove(temp.c_str());
+                throw snapshot_error("cannot write " + temp);
+            }
+        }
+        if (std::rename(temp.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temp.c_str());
+            throw snapshot_error("cannot rename " + temp + " to " + path);
+        }
+    }
+
+private:
+    memo_snapshot::player_table::builder player_;
+    memo_snapshot::dealer_table::builder dealer_;
+};
+
+} // namespace blackjack
@@ -6,7 +6,7 @@ namespace blackjack {
 
 struct outcome
 {
-    outcome(
+    constexpr outcome(
         double invested = 1,
         double returned = 0)
         : invested(invested)
@@ -17,7 +17,7 @@ struct outcome
     update(outcome const &other) noexcept
     { *this = other; }
 
-    outcome &
+    constexpr outcome &
     operator*=(double prob)
     {
         probability *= prob;
@@ -30,22 +30,24 @@ struct outcome
         assert(1.0 - probability < 0.999);
         invested += b.invested * b.probability;
         returned += b.returned * b.probability;
+        error += b.error * b.probability;
         return *this;
     }
 
-    double
+    constexpr double
     pnl() const
     { return returned - invested; }
 
-    double
+    constexpr double
     payoff() const
     { return pnl() / invested; }
 
-    void
+    constexpr void
     double_down()
     {
         invested *= 2;
         returned *= 2;
+        error *= 2;
     }
 
 
@@ -53,9 +55,13 @@ struct outcome
     double returned;
 
     double probability = 1.0;
+
+    /// how far pnl() may be from the exact value, for engines that
+    /// approximate; zero for exact results
+    double error = 0.0;
 };
 
-inline outcome
+constexpr inline outcome
 operator*(
     outcome l,
     double prob)
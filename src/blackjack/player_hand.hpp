@@ -14,19 +14,11 @@ struct player_hand
     is_pair() const
     {
         std::optional<card_scale> result;
-        int total_cards = 0;
+        if (count() != 2)
+            return result;
         for (std::size_t i = 0; i < store_.size(); ++i)
-        {
-            auto count = store_[i];
-            if (count)
-            {
-                total_cards += count;
-                if (count == 2)
-                    result = to_card_scale(i);
-            }
-        }
-        if (total_cards != 2)
-            result.reset();
+            if (store_[i] == 2)
+                result = to_card_scale(i);
         return result;
     }
 
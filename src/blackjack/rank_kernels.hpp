@@ -0,0 +1,217 @@
+#pragma once
+
+#include "cards.hpp"
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <string_view>
+
+#if defined(__x86_64__) and (defined(__GNUC__) or defined(__clang__))
+#include <immintrin.h>
+#define BLACKJACK_AVX2_KERNELS 1
+#endif
+
+namespace blackjack {
+
+/// Lanes in a rank_vector: the ten ranks padded to three AVX2 registers.
+constexpr std::size_t nof_rank_lanes = 12;
+
+/// One double per rank, indexed by to_index(card_scale). The padding lanes
+/// are zero, so they drop out of every sum.
+struct alignas(32) rank_vector
+{
+    std::array<double, nof_rank_lanes> lane {};
+
+    constexpr double &
+    operator[](card_scale c)
+    { return lane[to_index(c)]; }
+
+    constexpr double
+    operator[](card_scale c) const
+    { return lane[to_index(c)]; }
+};
+
+/// The draw probability of every rank in `s`, from one reciprocal of its
+/// size; all zero for an empty shoe.
+inline auto
+rank_probabilities_of(cards const &s) -> rank_vector
+{
+    auto result = rank_vector();
+    if (s.count() == 0)
+        return result;
+    auto inverse = 1.0 / double(s.count());
+    for (auto c : all_card_faces())
+        result[c] = double(s[c]) * inverse;
+    return result;
+}
+
+/// Sums of an outcome's fields over the ranks, weighted by probability.
+struct weighted_sums
+{
+    double invested = 0.0;
+    double returned = 0.0;
+    double error = 0.0;
+};
+
+/// The per-rank arithmetic of the recursion, in a scalar version and, on
+/// x86-64, an AVX2 and FMA version. get() picks one on first use: AVX2 if
+/// the CPU has both, unless the environment sets BLACKJACK_KERNELS=scalar.
+/// Both compute the same values, up to the order in which lanes are summed
+/// and the rounding of fused multiply-adds.
+struct rank_kernels
+{
+    /// Bits per rank of a packed count, as in dealer_dp's state keys.
+    static constexpr unsigned packed_bits = 5;
+
+    /// For each of `n` states, out[i][c] = (available[c] - count of c in
+    /// packed[i]) * scale[i]. Whole batches go through one call, so that
+    /// the dispatch costs nothing per state.
+    void (*remaining_weights)(
+        rank_vector const &available,
+        std::uint64_t const *packed,
+        double const *scale,
+        std::size_t n,
+        rank_vector *out);
+
+    /// the fields of the per-rank outcomes, weighted by `probability`
+    weighted_sums (*weigh)(
+        rank_vector const &probability,
+        rank_vector const &invested,
+        rank_vector const &returned,
+        rank_vector const &error);
+
+    char const *name;
+
+    static auto
+    get() -> rank_kernels const &
+    {
+        static auto const selected = select();
+        return selected;
+    }
+
+    static auto
+    scalar() -> rank_kernels
+    { return { &scalar_remaining_weights, &scalar_weigh, "scalar" }; }
+
+#ifdef BLACKJACK_AVX2_KERNELS
+    static auto
+    avx2() -> rank_kernels
+    { return { &avx2_remaining_weights, &avx2_weigh, "avx2" }; }
+#endif
+
+private:
+    static auto
+    select() -> rank_kernels
+    {
+        auto const *forced = std::getenv("BLACKJACK_KERNELS");
+        if (forced and std::string_view(forced) == "scalar")
+            return scalar();
+#ifdef BLACKJACK_AVX2_KERNELS
+        if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+            return avx2();
+#endif
+        return scalar();
+    }
+
+    static void
+    scalar_remaining_weights(
+        rank_vector const &available,
+        std::uint64_t const *packed,
+        double const *scale,
+        std::size_t n,
+        rank_vector *out)
+    {
+        constexpr auto mask = (std::uint64_t(1) << packed_bits) - 1;
+        for (std::size_t k = 0 ; k < n ; ++k)
+            for (std::size_t i = 0 ; i < nof_rank_lanes ; ++i)
+            {
+                auto drawn = i < nof_card_scales ? (packed[k] >> (packed_bits * i)) & mask : 0;
+                out[k].lane[i] = (available.lane[i] - double(drawn)) * scale[k];
+            }
+    }
+
+    static auto
+    scalar_weigh(
+        rank_vector const &probability,
+        rank_vector const &invested,
+        rank_vector const &returned,
+        rank_vector const &error) -> weighted_sums
+    {
+        auto result = weighted_sums();
+        for (std::size_t i = 0 ; i < nof_rank_lanes ; ++i)
+        {
+            result.invested += invested.lane[i] * probability.lane[i];
+            result.returned += returned.lane[i] * probability.lane[i];
+            result.error += error.lane[i] * probability.lane[i];
+        }
+        return result;
+    }
+
+#ifdef BLACKJACK_AVX2_KERNELS
+    __attribute__((target("avx2,fma"))) static void
+    avx2_remaining_weights(
+        rank_vector const &available,
+        std::uint64_t const *packed,
+        double const *scale,
+        std::size_t n,
+        rank_vector *out)
+    {
+        // counts below 2^52 become doubles by planting them in the mantissa
+        // of 2^52 and subtracting it again, as AVX2 has no int64 to double
+        auto const magic = _mm256_set1_epi64x(0x4330000000000000);
+        auto const offset = _mm256_set1_pd(4503599627370496.0);
+        auto const mask = _mm256_set1_epi64x((1 << packed_bits) - 1);
+        __m256i const shifts[3] = {
+            _mm256_setr_epi64x(0, packed_bits, 2 * packed_bits, 3 * packed_bits),
+            _mm256_setr_epi64x(4 * packed_bits, 5 * packed_bits, 6 * packed_bits, 7 * packed_bits),
+            _mm256_setr_epi64x(8 * packed_bits, 9 * packed_bits, 64, 64),
+        };
+        __m256d const avail[3] = {
+            _mm256_load_pd(&available.lane[0]),
+            _mm256_load_pd(&available.lane[4]),
+            _mm256_load_pd(&available.lane[8]),
+        };
+        for (std::size_t k = 0 ; k < n ; ++k)
+        {
+            auto const key = _mm256_set1_epi64x(std::int64_t(packed[k]));
+            auto const factor = _mm256_set1_pd(scale[k]);
+            for (int i = 0 ; i < 3 ; ++i)
+            {
+                // a shift by 64 yields zero, for the padding lanes
+                auto counts = _mm256_and_si256(_mm256_srlv_epi64(key, shifts[i]), mask);
+                auto drawn = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(counts, magic)), offset);
+                _mm256_store_pd(&out[k].lane[4 * i], _mm256_mul_pd(_mm256_sub_pd(avail[i], drawn), factor));
+            }
+        }
+    }
+
+    __attribute__((target("avx2,fma"))) static auto
+    avx2_weigh(
+        rank_vector const &probability,
+        rank_vector const &invested,
+        rank_vector const &returned,
+        rank_vector const &error) -> weighted_sums
+    {
+        auto inv = _mm256_setzero_pd();
+        auto ret = _mm256_setzero_pd();
+        auto err = _mm256_setzero_pd();
+        for (int i = 0 ; i < 3 ; ++i)
+        {
+            auto p = _mm256_load_pd(&probability.lane[4 * i]);
+            inv = _mm256_fmadd_pd(_mm256_load_pd(&invested.lane[4 * i]), p, inv);
+            ret = _mm256_fmadd_pd(_mm256_load_pd(&returned.lane[4 * i]), p, ret);
+            err = _mm256_fmadd_pd(_mm256_load_pd(&error.lane[4 * i]), p, err);
+        }
+        return weighted_sums { avx2_sum(inv), avx2_sum(ret), avx2_sum(err) };
+    }
+
+    __attribute__((target("avx2"))) static double
+    avx2_sum(__m256d v)
+    {
+        auto pair = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+    }
+#endif
+};
+
+} // namespace blackjack
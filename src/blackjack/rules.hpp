@@ -1,10 +1,13 @@
 #pragma once
 
 #include "score.hpp"
+#include "dealer_distribution.hpp"
 #include "player_hand.hpp"
 #include "dealer_hand.hpp"
 #include <cassert>
 #include <limits>
+#include <stdexcept>
+#include <type_traits>
 
 namespace blackjack {
 
@@ -63,7 +66,7 @@ struct rules
     int no_of_decks = 8;
     int cards_behind_cut = no_of_decks * 52 / 6;
 
-    auto
+    constexpr auto
     compute_result(
         score const &player_score,
         score const &dealer_score) const -> result
@@ -97,7 +100,7 @@ struct rules
         return compute_result(score(player), score(dealer));
     }
 
-    auto
+    constexpr auto
     payoff(result res) const -> double
     {
         switch (res)
@@ -111,7 +114,7 @@ struct rules
         return std::numeric_limits<double>::signaling_NaN();
     }
 
-    auto
+    constexpr auto
     payoff(
         score const &player_score,
         score const &dealer_score) const -> double
@@ -119,9 +122,30 @@ struct rules
         return payoff(compute_result(player_score, dealer_score));
     }
 
+    /// Expected return per unit staked by a player on `player_score`
+    /// against a dealer whose final result is distributed as `dealer`.
+    constexpr auto
+    payoff(
+        score const &player_score,
+        dealer_distribution const &dealer) const -> double
+    {
+        double result = 0.0;
+        for (int i = 0 ; i < nof_dealer_finals ; ++i)
+        {
+            auto f = static_cast<dealer_final>(i);
+            if (auto prob = dealer[f])
+                result += prob * payoff(player_score, to_score(f));
+        }
+        return result;
+    }
+
+    /// Pairs may be split once; a hand that came from a split is not split
+    /// again.
     bool
     may_split(player_hand const &player) const
     {
+        if (player.after_split())
+            return false;
         if (player.is_pair())
             return true;
         return false;
@@ -149,7 +173,7 @@ struct rules
         return may_hit(player);
     }
 
-    auto
+    constexpr auto
     select_dealer_action(score const &dealer_score) const -> dealer_action
     {
         if (dealer_score.value() > 16)
@@ -169,6 +193,11 @@ struct rules
         return select_dealer_action(score(hand));
     }
 
+    friend bool
+    operator==(
+        rules const &,
+        rules const &) = default;
+
     friend std::ostream &
     operator<<(
         std::ostream &os,
@@ -189,4 +218,75 @@ struct rules
 
 };
 
-}
\ No newline at end of file
+/// The rules an engine is specialized on. runtime_rules reads them from a
+/// `rules` the engine was given; static_rules fixes the two an engine's
+/// inner loops branch on, soft 17 and double after split, at compile time.
+/// Either way, get() has the rules in effect; for static_rules it is a
+/// constant, so every branch on it folds away. The number of decks and the
+/// cut card are not part of a rule set, as the engines read those from the
+/// shoe.
+class runtime_rules
+{
+public:
+    constexpr explicit runtime_rules(rules const &r)
+        : rules_(r)
+    {}
+
+    constexpr auto
+    get() const -> rules const &
+    { return rules_; }
+
+private:
+    rules const &rules_;
+};
+
+template<bool H17, bool DAS>
+struct static_rules
+{
+    static constexpr bool dealer_draw_on_soft_17 = H17;
+    static constexpr bool allow_double_after_split = DAS;
+
+    constexpr static_rules() = default;
+
+    /// Throws std::invalid_argument unless `r` is one of these rules.
+    constexpr explicit static_rules(rules const &r)
+    {
+        if (!matches(r))
+            throw std::invalid_argument("rules do not match the engine's rule set");
+    }
+
+    static constexpr auto
+    get() -> rules
+    {
+        auto r = rules();
+        r.dealer_draw_on_soft_17 = H17;
+        r.allow_double_after_split = DAS;
+        return r;
+    }
+
+    static constexpr bool
+    matches(rules const &r)
+    {
+        return r.dealer_draw_on_soft_17 == H17 and r.allow_double_after_split == DAS;
+    }
+};
+
+/// Calls f with a std::type_identity of the static_rules matching `r`.
+template<class F>
+auto
+dispatch_rules(
+    rules const &r,
+    F &&f)
+{
+    if (r.dealer_draw_on_soft_17)
+    {
+        if (r.allow_double_after_split)
+            return f(std::type_identity<static_rules<true, true>>());
+        return f(std::type_identity<static_rules<true, false>>());
+    }
+    if (r.allow_double_after_split)
+        return f(std::type_identity<static_rules<false, true>>());
+    return f(std::type_identity<static_rules<false, false>>());
+}
+
+}
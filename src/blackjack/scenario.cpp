@@ -0,0 +1,10 @@
+#include "scenario.hpp"
+
+namespace blackjack {
+
+template struct basic_scenario<no_trace, static_rules<false, false>>;
+template struct basic_scenario<no_trace, static_rules<false, true>>;
+template struct basic_scenario<no_trace, static_rules<true, false>>;
+template struct basic_scenario<no_trace, static_rules<true, true>>;
+
+} // namespace blackjack
@@ -1,80 +1,153 @@
 #pragma once
 
+#include "dealer_dp.hpp"
 #include "dealer_hand.hpp"
 #include "outcome.hpp"
 #include "player_hand.hpp"
+#include "polyfill/cancellation.hpp"
+#include "polyfill/sharded_memo.hpp"
 #include "polyfill/static_vector.hpp"
 #include "polyfill/universal.hpp"
+#include "memo_snapshot.hpp"
+#include "rank_kernels.hpp"
 #include "rules.hpp"
+#include "scenario_result.hpp"
+#include "scenario_stats.hpp"
 #include "score.hpp"
 #include "shoe.hpp"
+#include "state_key.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <ostream>
 #include <iostream>
+#include <limits>
+#include <utility>
 
 namespace blackjack {
 
-enum class player_action
+/// The memo tables of the exact engine. Any number of engines, on any
+/// number of threads, can look up and fill the same tables at once, so that
+/// workers evaluating related decisions share one copy of every state; an
+/// engine is still used by one thread at a time. Entries are only valid
+/// for engines of the same rules and epsilon. With pruning, an entry's
+/// value only depends on its key (see basic_scenario::reach_class), so it
+/// does not matter which engine claims a state first: the results are the
+/// same however the workers' searches interleave.
+struct scenario_tables
 {
-    hit,
-    stick,
-    double_down,
-    split,
-};
-
-inline auto
-operator<<(
-    std::ostream &os,
-    player_action pa) -> std::ostream &
-{
-    switch (pa)
-    {
-    case player_action::double_down:os << "double down";
-        break;
-    case player_action::hit:os << "hit";
-        break;
-    case player_action::stick:os << "stick";
-        break;
-    case player_action::split:os << "split";
-        break;
-    }
-
-    return os;
-}
+    using player_map = polyfill::sharded_memo<player_state_key, memo_result>;
+    using dealer_map = polyfill::sharded_memo<dealer_state_key, dealer_distribution>;
 
-struct scenario_result
-    : outcome
-{
-    scenario_result(player_action action) : action(action)
-        , outcome()
+    /// `memo_bytes` is split evenly between the dealer and player tables.
+    explicit scenario_tables(std::size_t memo_bytes)
+        : player(memo_bytes / 2)
+        , dealer(memo_bytes / 2)
     {}
 
-    player_action action;
-
-    friend auto
-    operator<<(
-        std::ostream &os,
-        scenario_result const &sr)
-    -> std::ostream &
-    {
-        return os << sr.action << " : pays " << sr.payoff();
-    }
+    player_map player;
+    dealer_map dealer;
+};
 
+struct scenario_options
+{
+    /// upper bound on the bytes held by the memo tables, split evenly
+    /// between the dealer and player tables
+    std::size_t memo_bytes = std::size_t(1) << 30;
+
+    /// tables shared with other engines; if null, the engine makes tables
+    /// of its own of memo_bytes
+    std::shared_ptr<scenario_tables> tables;
+
+    /// memo entries persisted by an earlier run, consulted after a miss in
+    /// the in-memory tables
+    std::shared_ptr<memo_snapshot const> snapshot;
+
+    /// polled at every player state, and while waiting for a state that
+    /// another engine sharing the tables is searching; once raised, run()
+    /// and evaluate() throw polyfill::operation_cancelled. Entries already
+    /// memoized stay valid.
+    polyfill::cancellation_token const *cancel = nullptr;
+
+    /// Player states that the search reaches with a probability below this
+    /// are estimated rather than searched, and dealer states less likely
+    /// than this are dropped. Every result then carries in `error` a bound
+    /// on how far its pnl can be from the exact one. Zero searches
+    /// everything.
+    double epsilon = 0.0;
+
+    /// How long an engine that answers within a time limit (see
+    /// anytime_scenario) may take per evaluation.
+    std::chrono::nanoseconds time_budget = std::chrono::milliseconds(100);
 };
 
-struct scenario
+/// The exact engine. Trace selects whether the engine can explain its
+/// reasoning (full_trace, used by why and whylog) or compiles every trace
+/// call away (no_trace, the production engine). RuleSet selects whether
+/// the rules are read at runtime or fixed at compile time (see
+/// static_rules); a static rule set only takes rules it matches.
+template<class Trace, class RuleSet = runtime_rules>
+struct basic_scenario
 {
+    using context = typename Trace::context;
+
     using result_vector = polyfill::static_vector<scenario_result, 4>;
 
-    using player_key = std::tuple<player_hand, dealer_hand, shoe, cards /* burn pile */>;
-    using player_memo_map = std::unordered_map<player_key, scenario_result, polyfill::universal_hash, polyfill::universal_equal_to>;
+    using player_key = player_state_key;
+    using player_memo_map = scenario_tables::player_map;
+
+    using memo_key = dealer_state_key;
+    using memo_map = scenario_tables::dealer_map;
+
+    static auto
+    make_player_key(
+        player_hand const &p,
+        dealer_hand const &d,
+        shoe const &s,
+        cards const &burn_pile,
+        int reach_class = 0) -> player_key
+    {
+        auto packer = key_packer<player_key::nof_words>();
+        auto pair = p.after_split() ? std::nullopt : p.is_pair();
+        packer.push_hand_state(p);
+        packer.push(p.after_split());
+        packer.push(pair ? to_index(*pair) + 1 : 0, pair_rank_bits);
+        packer.push_hand_state(d);
+        packer.push(s, shoe_rank_bits);
+        packer.push(static_cast<std::uint64_t>(s.cards_behind_cut), cut_bits);
+        packer.push(burn_pile, shoe_rank_bits);
+        packer.push(static_cast<std::uint64_t>(reach_class), reach_bits);
+        return packer.key();
+    }
 
-    using memo_key = std::tuple<score, dealer_hand, shoe, cards /* burn pile */>;
-    using memo_map =
-    std::unordered_map<memo_key, outcome, polyfill::universal_hash,
-        polyfill::universal_equal_to>;
+    static auto
+    make_memo_key(
+        dealer_hand const &d,
+        shoe const &s,
+        cards const &burn_pile,
+        int reach_class = 0) -> memo_key
+    {
+        auto packer = key_packer<memo_key::nof_words>();
+        packer.push_hand_state(d);
+        packer.push(s, shoe_rank_bits);
+        packer.push(static_cast<std::uint64_t>(s.cards_behind_cut), cut_bits);
+        packer.push(burn_pile, shoe_rank_bits);
+        packer.push(static_cast<std::uint64_t>(reach_class), reach_bits);
+        return packer.key();
+    }
 
-    scenario(rules const &r) : rules_(r)
+    basic_scenario(
+        rules const &r,
+        scenario_options const &opts = scenario_options())
+        : rules_(r)
+        , tables_(opts.tables ? opts.tables : std::make_shared<scenario_tables>(opts.memo_bytes))
+        , memo_(tables_->dealer)
+        , player_memo_(tables_->player)
+        , snapshot_(opts.snapshot)
+        , cancel_(opts.cancel)
+        , epsilon_(opts.epsilon)
     {}
 
     static scenario_result
@@ -85,22 +158,30 @@ struct scenario
         auto last = v.end();
 
         auto result = *first++;
+        auto error = result.error;
         while (first != last)
         {
             if (first->pnl() > result.pnl())
                 result = *first;
+            error = std::max(error, first->error);
             ++first;
         }
 
+        // the best of the estimates is within the largest of their errors
+        // of the best of the exact values, whichever action that is
+        result.error = error;
         return result;
     }
 
+    /// Draws one card to `p` and plays on; `reach` is the probability of
+    /// the search getting to `p` at all.
     auto
     hit_player(
         shoe s,
         player_hand const &p,
         dealer_hand const &d,
-        cards burn_pile)
+        cards burn_pile,
+        double reach)
     -> outcome
     {
         if (s.exhausted())
@@ -110,12 +191,14 @@ struct scenario
             burn_pile.clear();
         }
 
-        polyfill::static_vector<outcome, nof_card_scales> outcomes;
-        int total_cards_in_shoe = 0;
+        auto probability = rank_probabilities_of(s);
+        auto invested = rank_vector();
+        auto returned = rank_vector();
+        auto error = rank_vector();
         for (auto c : all_card_faces())
         {
             auto ctx = context(to_char(c));
-            auto prob = s.probability(c);
+            auto prob = probability[c];
             if (prob)
             {
                 auto s2 = s;
@@ -124,21 +207,25 @@ struct scenario
                 auto scr = score(p2);
                 chatter(ctx, "deal ", c, " with chance ", polyfill::percentage(prob), " scores ", scr);
                 auto handle_score = [&]() -> outcome {
-                    if (!scr.bust())
+                    if (!scr.bust() and reach * prob < epsilon_)
                     {
-                        auto o = run_impl(ctx, s2, p2, d, burn_pile);
-                        o *= double(prob);
-                        chatter(ctx, "results in : ", o);
-                        return outcome(o);
+                        auto o = estimate(s, scr, p2, d, burn_pile, reach);
+                        chatter(ctx, "too unlikely to search, estimated as : ", o * prob);
+                        return o;
                     }
-                    else
+                    else if (!scr.bust())
                     {
-                        auto o = outcome(1, 0);
-                        o *= prob;
-                        return o;
+                        auto o = run_impl(ctx, s2, p2, d, burn_pile, reach * prob);
+                        chatter(ctx, "results in : ", o * prob);
+                        return outcome(o);
                     }
+                    else
+                        return outcome(1, 0);
                 };
-                outcomes.push_back(handle_score());
+                auto o = handle_score();
+                invested[c] = o.invested;
+                returned[c] = o.returned;
+                error[c] = o.error;
             }
             else
             {
@@ -146,15 +233,34 @@ struct scenario
             }
         }
 
-        double invested = 0.0;
-        double pay = 0.0;
-        for (auto &&o : outcomes)
-        {
-            invested += o.invested * o.probability;
-            pay += o.returned * o.probability;
-        }
+        auto sums = kernels_.weigh(probability, invested, returned, error);
+        auto result = outcome(sums.invested, sums.returned);
+        result.error = sums.error;
+        return result;
+    }
 
-        return outcome(invested, pay);
+    /// Stands in for searching a player state that is too unlikely to be
+    /// worth it: the value of standing on `player_score` against the dealer
+    /// outcomes of the shoe before the card was drawn. Whatever the player
+    /// does, the pnl lies between losing one stake and winning one, or two
+    /// if the hand may still act and double, and the error covers that
+    /// range.
+    auto
+    estimate(
+        shoe const &parent,
+        score const &player_score,
+        player_hand const &p,
+        dealer_hand const &d,
+        cards const &burn_pile,
+        double reach,
+        bool may_act = true)
+    -> outcome
+    {
+        ++stats_.player_pruned;
+        auto o = dealers_turn(parent, player_score, d, burn_pile, reach);
+        auto best = may_act and rules_.get().may_double(p) ? 2.0 : 1.0;
+        o.error = std::max(o.pnl() + 1.0, best - o.pnl());
+        return o;
     }
 
     auto
@@ -162,7 +268,8 @@ struct scenario
         shoe s,
         player_hand const &p,
         dealer_hand const &d,
-        cards burn_pile)
+        cards burn_pile,
+        double reach)
     -> outcome
     {
         const char* shuffle_msg = "";
@@ -172,92 +279,237 @@ struct scenario
             burn_pile.clear();
             shuffle_msg = "shuffle...";
         }
-        polyfill::static_vector<outcome, nof_card_scales> outcomes;
+        auto probability = rank_probabilities_of(s);
+        auto invested = rank_vector();
+        auto returned = rank_vector();
+        auto error = rank_vector();
         for (auto c : all_card_faces())
         {
-            auto prob = s.probability(c);
-            auto ctx = context(c);
+            auto prob = probability[c];
+            auto ctx = context(to_char(c));
             chatter(ctx, shuffle_msg, "draw ", c, " probability ", polyfill::percentage(prob));
             if (auto avail = s[c];avail)
             {
                 auto s2 = s;
                 auto p2 = p;
                 deal_one(s2, p2, c);
-                outcomes.push_back(dealers_turn(s2, score(p2), d, burn_pile) * prob);
-                chatter(ctx, "result: ", outcomes.back());
+                auto scr = score(p2);
+                // like hit_player, a draw too unlikely to follow is
+                // estimated from the shoe it came from
+                auto o = !scr.bust() and reach * prob < epsilon_
+                         ? estimate(s, scr, p2, d, burn_pile, reach, false)
+                         : dealers_turn(s2, scr, d, burn_pile, reach * prob);
+                chatter(ctx, "result: ", o * prob);
+                invested[c] = o.invested;
+                returned[c] = o.returned;
+                error[c] = o.error;
             }
         }
 
-        double invested = 0.0;
-        double pay = 0.0;
-        for (auto &&o : outcomes)
-        {
-            invested += o.invested * o.probability;
-            pay += o.returned * o.probability;
-        }
-        return outcome(invested, pay);
+        auto sums = kernels_.weigh(probability, invested, returned, error);
+        auto result = outcome(sums.invested, sums.returned);
+        result.error = sums.error;
+        return result;
+    }
+
+    /// Splits a pair into two hands of one card each, which then draw from
+    /// this shoe and play on as hands after a split. Both hands are played
+    /// alike, so the result is twice that of one of them. That is an
+    /// approximation: the cards the other hand takes are not removed from
+    /// the shoe first, so the error includes split_error() even without
+    /// pruning.
+    auto
+    split_player(
+        shoe const &s,
+        player_hand const &p,
+        dealer_hand const &d,
+        cards const &burn_pile,
+        double reach)
+    -> outcome
+    {
+        auto one = player_hand(*p.is_pair());
+        one.set_after_split();
+        auto o = hit_player(s, one, d, burn_pile, reach);
+        o.invested *= 2;
+        o.returned *= 2;
+        o.error = 2 * o.error + split_error(s, *p.is_pair(), d);
+        return o;
     }
 
-    struct context;
+    /// Bounds how far twice the value of one hand after a split may be from
+    /// that of playing both hands from one shoe. The second hand and the
+    /// dealer draw from a shoe without the first hand's cards, and the
+    /// first hand's dealer from one without the second's. Drawing m cards
+    /// from a shoe of n, k cards fewer changes the chance of any sequence
+    /// of draws by at most k * m / n in total, so each hand's value moves
+    /// by at most that times the range of its pnl. The bound allows for the
+    /// longest draws a hand and the dealer can make, so it is loose:
+    /// measured differences are far smaller. Where the cut card comes
+    /// within reach it is just the range of both hands.
+    auto
+    split_error(
+        shoe const &s,
+        card_scale pair,
+        dealer_hand const &d) const -> double
+    {
+        auto range = rules_.get().allow_double_after_split ? 4.0 : 2.0;
+        auto hand_draws = std::max(0, 22 - hard_value(pair));
+        auto dealer_draws = dealer_draw_bound(d);
+        if (s.count() - s.cards_behind_cut < 2 * hand_draws + dealer_draws)
+            return 2 * range;
+        auto n = double(s.count());
+        auto second = range * hand_draws * (hand_draws + dealer_draws) / n;
+        auto first = range * hand_draws * dealer_draws / (n - hand_draws);
+        return std::min(first, range) + std::min(second, range);
+    }
 
-    inline auto
-    run_impl(
+    /// Evaluates every action available to the player.
+    auto
+    consider_all(
         context const &ctx,
         shoe const &s,
         player_hand const &p,
         dealer_hand const &d,
-        cards const &burn_pile)
-    -> scenario_result
+        cards const &burn_pile,
+        double reach)
+    -> result_vector
     {
-        auto key = std::tie(p, d, s, burn_pile);
-        auto imemo = player_memo_.find(key);
-        if (imemo == player_memo_.end())
+        if (cancel_)
+            cancel_->throw_if_cancelled();
+        ++stats_.player_nodes;
+        auto possible_results = result_vector();
+
+        if (rules_.get().may_stick(p))
         {
-            auto possible_results = polyfill::static_vector<scenario_result, 4>();
+            chatter(ctx, "consider stick:");
+            auto &res =
+                possible_results.push_back(scenario_result(player_action::stick));
+            auto o = dealers_turn(s, score(p), d, burn_pile, reach);
+            chatter(ctx, "would result in :", o);
+            res.update(o);
+        }
 
-            if (rules_.may_stick(p))
-            {
-                chatter(ctx, "consider stick:");
-                auto &res =
-                    possible_results.push_back(scenario_result(player_action::stick));
-                auto o = dealers_turn(s, score(p), d, burn_pile);
-                chatter(ctx, "would result in :", o);
-                res.update(o);
-            }
+        if (rules_.get().may_hit(p))
+        {
+            chatter(ctx, "consider card:");
+            auto &res =
+                possible_results.push_back(scenario_result(player_action::hit));
+            auto o = hit_player(s, p, d, burn_pile, reach);
+            chatter(ctx, "would result in :", o);
+            res.update(o);
+        }
+        if (rules_.get().may_double(p))
+        {
+            chatter(ctx, "consider double:");
+            auto &res = possible_results.push_back(
+                scenario_result(player_action::double_down));
+            auto o = hit_player_once(s, p, d, burn_pile, reach);
+            o.double_down();
+            chatter(ctx, "would result in :", o);
+            res.update(o);
+        }
+        if (rules_.get().may_split(p))
+        {
+            chatter(ctx, "consider split:");
+            auto &res = possible_results.push_back(
+                scenario_result(player_action::split));
+            auto o = split_player(s, p, d, burn_pile, reach);
+            chatter(ctx, "would result in :", o);
+            res.update(o);
+        }
 
-            if (rules_.may_hit(p))
-            {
-                chatter(ctx, "consider card:");
-                auto &res =
-                    possible_results.push_back(scenario_result(player_action::hit));
-                auto o = hit_player(s, p, d, burn_pile);
-                chatter(ctx, "would result in :", o);
-                res.update(o);
-            }
-            if (rules_.may_double(p))
-            {
-                chatter(ctx, "consider double:");
-                auto &res = possible_results.push_back(
-                    scenario_result(player_action::double_down));
-                auto o = hit_player_once(s, p, d, burn_pile);
-                o.double_down();
-                chatter(ctx, "would result in :", o);
-                res.update(o);
-            }
-            /*
-            if (r.may_split(p))
-                possible_results.push_back(scenario_result(player_action::split));
-        */
+        return possible_results;
+    }
+
+    /// Upper bound on the cards the dealer draws from `d`: it stands by a
+    /// hard 17 at the latest.
+    static int
+    dealer_draw_bound(dealer_hand const &d)
+    {
+        return std::max(0, 17 - d.hard_total());
+    }
+
+    /// Upper bound on the cards the player draws to `p`: one past a hard 21
+    /// busts, and a pair that may be split starts again from one card.
+    int
+    player_draw_bound(player_hand const &p) const
+    {
+        auto hard = p.hard_total();
+        if (rules_.get().may_split(p))
+            hard = hard_value(*p.is_pair());
+        return std::max(0, 22 - hard);
+    }
 
-            imemo = player_memo_.emplace(key, best_of(possible_results)).first;
-            chatter(ctx, "result: ", imemo->second);
+    /// Brings a state to the form it is memoized under. An exhausted shoe
+    /// is reshuffled before its next draw anyway, so the burn pile is merged
+    /// in up front; and if no more than `draws` cards can be taken before
+    /// the cut card, the burn pile never comes back into play and is
+    /// dropped, and the cut is moved to the back of the shoe, so that the
+    /// state is shared by shoes that only differ in where the cut is.
+    static void
+    canonicalize(
+        shoe &s,
+        cards &burn_pile,
+        int draws)
+    {
+        if (s.exhausted())
+        {
+            s += burn_pile;
+            burn_pile.clear();
         }
-        else
+        else if (draws <= s.count() - s.cards_behind_cut)
         {
-            chatter(ctx, "cached result: ", imemo->second);
+            burn_pile.clear();
+            s.cards_behind_cut = 0;
         }
+    }
+
+    /// The n for which 2^-n is the smallest power of two at or above
+    /// `reach`, or zero without pruning. A memoized state is searched at
+    /// reach 2^-n and keyed by n, so what is pruned below it, and so its
+    /// entry, only depends on the key and not on which path got there
+    /// first; the engines filling shared tables then agree whatever the
+    /// order. The search prunes at most as much as the true reach asks for.
+    auto
+    reach_class(double reach) const -> int
+    {
+        if (epsilon_ <= 0)
+            return 0;
+        auto n = static_cast<int>(std::floor(-std::log2(reach)));
+        return std::clamp(n, 0, (1 << reach_bits) - 1);
+    }
 
-        return imemo->second;
+    inline auto
+    run_impl(
+        context const &ctx,
+        shoe s,
+        player_hand const &p,
+        dealer_hand const &d,
+        cards burn_pile,
+        double reach)
+    -> scenario_result
+    {
+        canonicalize(s, burn_pile, player_draw_bound(p) + dealer_draw_bound(d));
+        auto n = reach_class(reach);
+        reach = std::ldexp(1.0, -n);
+        auto key = make_player_key(p, d, s, burn_pile, n);
+        ++stats_.player.lookups;
+        // every state searched from here has fewer cards left, so no wait
+        // for a state another engine is searching can close a cycle
+        auto [value, found] = player_memo_.find_or_make(key, [&] {
+            if (snapshot_ and not chat_)
+                if (auto *snapped = snapshot_->find_player(key))
+                {
+                    ++stats_.player.snapshot_hits;
+                    return *snapped;
+                }
+            return memo_result(best_of(consider_all(ctx, s, p, d, burn_pile, reach)));
+        }, cancel_);
+        if (found)
+            ++stats_.player.hits;
+        auto result = value.result();
+        chatter(ctx, found ? "cached result: " : "result: ", result);
+        return result;
     }
 
     inline auto
@@ -268,8 +520,22 @@ struct scenario
         cards const &burn_pile)
     -> scenario_result
     {
-        auto ctx = recursing() ? context() : context(to_string(p));
-        return run_impl(ctx, s, p, d, burn_pile);
+        auto ctx = recursing() ? context() : named_context(p);
+        return run_impl(ctx, s, p, d, burn_pile, 1.0);
+    }
+
+    /// Like run(), but reports the outcome of every available action rather
+    /// than only the best one.
+    auto
+    evaluate(
+        shoe const &s,
+        player_hand const &p,
+        dealer_hand const &d,
+        cards const &burn_pile)
+    -> result_vector
+    {
+        auto ctx = recursing() ? context() : named_context(p);
+        return consider_all(ctx, s, p, d, burn_pile, 1.0);
     }
 
     auto
@@ -286,53 +552,54 @@ struct scenario
     dealers_turn_impl(
         context const &last_ctx,
         shoe const &s,
-        score const &player_score,
         dealer_hand const &d,
-        cards const &burn_pile) -> outcome
+        cards const &burn_pile,
+        double reach) -> dealer_distribution
     {
+        ++stats_.dealer_nodes;
         auto accumulated_deal_one = [&] {
-            polyfill::static_vector<outcome, nof_card_scales> outcomes;
-            int total_cards_in_shoe = 0;
+            // like hit_player, reshuffle before the draw so that the
+            // probabilities are those of the shoe the card comes from
+            auto s1 = s;
+            auto bp1 = burn_pile;
+            const char* exhaust = "";
+            if (s1.exhausted())
+            {
+                s1 += bp1;
+                bp1.clear();
+                exhaust = "reshuffle...";
+            }
+            auto result = dealer_distribution();
             for (auto card : all_card_faces())
             {
-                auto prob = s.probability(card);
-                if (auto avail = s[card];avail)
+                auto prob = s1.probability(card);
+                if (s1[card] and reach * prob < epsilon_)
                 {
-                    auto bp2 = burn_pile;
-                    auto s2 = s;
-                    const char* exhaust = "";
-                    if (s2.exhausted())
-                    {
-                        s2 += bp2;
-                        bp2.clear();
-                        exhaust = "reshuffle...";
-                    }
+                    ++stats_.dealer_pruned;
+                    chatter(last_ctx, "dealer drawing ", card, " is too unlikely to follow");
+                }
+                else if (auto avail = s1[card];avail)
+                {
+                    auto bp2 = bp1;
+                    auto s2 = s1;
                     auto d2 = d;
                     deal_one(s2, d2, card);
                     auto ctx = context(to_char(card));
                     chatter(ctx, exhaust, "dealer draws ", card, " with probability ", polyfill::percentage(prob));
-                    outcomes.push_back(dealers_turn_impl(ctx, s2, player_score, d2, bp2) *
-                                       prob);
-                    chatter(ctx, "outcome: ", outcomes.back());
+                    auto dd = dealers_turn_impl(ctx, s2, d2, bp2, reach * prob);
+                    chatter(ctx, "outcome: ", dd);
+                    dd *= prob;
+                    result += dd;
                 }
                 else
                 {
                     chatter(last_ctx, "no ", card, " in shoe");
                 }
             }
-            double invested = 0.0;
-            double pay = 0.0;
-            for (auto &&o : outcomes)
-            {
-                invested += o.invested * o.probability;
-                pay += o.returned * o.probability;
-            }
-
-            auto result = outcome(invested, pay);
             return result;
         };
         auto dealer_score = score(d);
-        switch (rules_.select_dealer_action(dealer_score))
+        switch (rules_.get().select_dealer_action(dealer_score))
         {
         case dealer_action::hit:
         {
@@ -341,11 +608,60 @@ struct scenario
         case dealer_action::stand:
         {
             chatter(last_ctx, "dealer stands on ", dealer_score);
-            return outcome(1, rules_.payoff(player_score, dealer_score));
+            return dealer_distribution::certain(to_dealer_final(dealer_score));
         }
         }
         assert(!"logic error");
-        return outcome();
+        return dealer_distribution();
+    }
+
+    /// The distribution of the dealer's final result from this dealer
+    /// state, computed once and shared by every player score. The traced
+    /// engine recurses so that every draw can be explained; the production
+    /// engine uses the bottom-up dealer_dp. Dealer states whose probability,
+    /// times the `reach` of the player state asking (rounded as by
+    /// reach_class()), is below epsilon are dropped; a distribution memoized
+    /// that way keeps the shortfall in its total wherever it is used.
+    auto
+    dealer_outcomes(
+        shoe s,
+        dealer_hand const &d,
+        cards burn_pile,
+        double reach = 1.0) -> dealer_distribution
+    {
+        auto ctx = named_context(d, " ");
+        canonicalize(s, burn_pile, dealer_draw_bound(d));
+        auto n = reach_class(reach);
+        reach = std::ldexp(1.0, -n);
+        auto key = make_memo_key(d, s, burn_pile, n);
+        ++stats_.dealer.lookups;
+        auto [value, found] = memo_.find_or_make(key, [&] {
+            if (snapshot_ and not chat_)
+                if (auto *snapped = snapshot_->find_dealer(key))
+                {
+                    ++stats_.dealer.snapshot_hits;
+                    return *snapped;
+                }
+            chatter(ctx, "dealer plays");
+            auto dd = dealer_distribution();
+            if constexpr (Trace::enabled)
+                dd = dealers_turn_impl(ctx, s, d, burn_pile, reach);
+            else
+            {
+                auto nodes = dealer_dp_.nodes();
+                auto pruned = dealer_dp_.pruned();
+                dd = dealer_dp_(rules_, s, d, burn_pile, epsilon_ / reach);
+                stats_.dealer_nodes += dealer_dp_.nodes() - nodes;
+                stats_.dealer_pruned += dealer_dp_.pruned() - pruned;
+            }
+            return dd;
+        }, cancel_);
+        if (found)
+        {
+            ++stats_.dealer.hits;
+            chatter(ctx, "cached result: ", value);
+        }
+        return value;
     }
 
     auto
@@ -353,27 +669,60 @@ struct scenario
         shoe const &s,
         score const &player_score,
         dealer_hand const &d,
-        cards const &burn_pile) -> outcome
+        cards const &burn_pile,
+        double reach = 1.0) -> outcome
     {
-        auto ctx0 = context();
-        auto ctx = context(to_string(d));
-        auto key = std::tie(player_score, d, s, burn_pile);
-        auto imemo = memo_.find(key);
-        if (imemo == memo_.end())
-        {
-            chatter(ctx, "dealer plays");
-            auto o = dealers_turn_impl(ctx, s, player_score, d, burn_pile);
-            imemo = memo_.emplace(key, o).first;
-        }
-        else
+        auto dd = dealer_outcomes(s, d, burn_pile, reach);
+        auto result = outcome(1, rules_.get().payoff(player_score, dd));
+        auto total = dd.total();
+        if (epsilon_ > 0 and total < 1)
         {
-            chatter(ctx, "cached result: ", imemo->second);
+            // the dealer's pruned draws pay somewhere in the range of
+            // payoffs; they are counted as paying the average of those
+            // followed or, if every draw was pruned, the middle of the range
+            auto missing = std::max(0.0, 1.0 - total);
+            auto lo = std::numeric_limits<double>::infinity();
+            auto hi = -lo;
+            for (int i = 0 ; i < nof_dealer_finals ; ++i)
+            {
+                auto pay = rules_.get().payoff(player_score, to_score(static_cast<dealer_final>(i)));
+                lo = std::min(lo, pay);
+                hi = std::max(hi, pay);
+            }
+            auto centre = total > 0 ? result.returned / total : (lo + hi) / 2;
+            result.returned = centre;
+            result.error = missing * std::max(centre - lo, hi - centre);
         }
-        return imemo->second;
+        return result;
+    }
+
+    /// The engine's counters so far, with the current occupancy of its memo
+    /// tables, which other engines may share. Subtract an earlier snapshot
+    /// to get the work in between.
+    auto
+    stats() const -> scenario_stats
+    {
+        auto result = stats_;
+        result.player_table = player_memo_.occupancy();
+        result.dealer_table = memo_.occupancy();
+        return result;
+    }
+
+    /// Polls `token` from now on, in place of the cancel token of the
+    /// options, or nothing if it is null. Returns the token it replaces.
+    auto
+    set_cancellation(polyfill::cancellation_token const *token)
+        -> polyfill::cancellation_token const *
+    {
+        return std::exchange(cancel_, token);
     }
 
+    /// Directs the trace to `logger`, or stops tracing if it is null. The
+    /// memo tables, shared ones included, are cleared so that the trace
+    /// covers the whole search.
     void
     chat(std::ostream *logger)
+        requires Trace::enabled
     {
         chat_ = logger;
         if (chat_)
@@ -383,47 +732,18 @@ struct scenario
         }
     }
 
-    struct context
+    /// A context labelled with `h`, after `prefix`, which is only rendered
+    /// when tracing.
+    static auto
+    named_context(
+        hand const &h,
+        const char *prefix = "") -> context
     {
-        friend std::ostream &
-        operator<<(
-            std::ostream &os,
-            context const &co)
-        {
-            os << context_string_;
-            return os;
-        }
-
-        explicit context(char c = ' ')
-            : adjust_(1)
-        {
-            context_string_ += c;
-        }
-
-        explicit context(std::string const &s)
-            : adjust_(s.size())
-        {
-            context_string_ += s;
-        }
-
-        explicit context(const char *p)
-            : adjust_(std::strlen(p))
-        {
-            context_string_ += p;
-        }
-
-        context(context &&other)
-            : adjust_(std::exchange(other.adjust_, 0))
-        {
-        }
-
-        ~context()
-        {
-            context_string_.erase(context_string_.end() - adjust_, context_string_.end());
-        }
-
-        int adjust_;
-    };
+        if constexpr (Trace::enabled)
+            return context(prefix + to_string(h));
+        else
+            return context();
+    }
 
     template<class...Args>
     void
@@ -431,32 +751,72 @@ struct scenario
         context const &ctx,
         Args &&...args) const
     {
-        if (not chat_)
-            return;
+        if constexpr (Trace::enabled)
+        {
+            if (not chat_)
+                return;
 
-        auto &log = *chat_;
-        log << ctx << ' ';
+            auto &log = *chat_;
+            log << ctx << ' ';
 
-        ((log << args), ...);
+            ((log << args), ...);
 
-        log << '\n';
+            log << '\n';
+        }
     }
 
-    bool
-    recursing() const
+    static bool
+    recursing()
     {
-        return !context_string_.empty();
+        return Trace::recursing();
     }
 
 
-    rules const &rules_;
-    memo_map memo_;
-
-    player_memo_map player_memo_;
+    [[no_unique_address]] RuleSet rules_;
+    std::shared_ptr<scenario_tables> tables_;
+    memo_map &memo_;
+    player_memo_map &player_memo_;
+    std::shared_ptr<memo_snapshot const> snapshot_;
+    polyfill::cancellation_token const *cancel_ = nullptr;
+    double epsilon_ = 0.0;
     std::ostream *chat_ = nullptr;
-    static thread_local std::string context_string_;
+    scenario_stats stats_;
+    dealer_dp dealer_dp_;
+    rank_kernels const &kernels_ = rank_kernels::get();
 };
 
-thread_local inline std::string scenario::context_string_ = "";
+/// The production engine.
+using scenario = basic_scenario<no_trace>;
+
+/// The engine behind why and whylog.
+using traced_scenario = basic_scenario<full_trace>;
+
+/// The production engine, specialized for a static rule set.
+template<class RuleSet>
+using specialized_scenario = basic_scenario<no_trace, RuleSet>;
+
+/// Engine, specialized for RuleSet if it is an exact engine. The
+/// approximations look their rules up in tables built per rule set, and
+/// stay as they are.
+template<class Engine, class RuleSet>
+struct with_rule_set
+{
+    using type = Engine;
+};
+
+template<class Trace, class R, class RuleSet>
+struct with_rule_set<basic_scenario<Trace, R>, RuleSet>
+{
+    using type = basic_scenario<Trace, RuleSet>;
+};
+
+template<class Engine, class RuleSet>
+using with_rule_set_t = typename with_rule_set<Engine, RuleSet>::type;
+
+/// The common casino rule sets are compiled once, in scenario.cpp.
+extern template struct basic_scenario<no_trace, static_rules<false, false>>;
+extern template struct basic_scenario<no_trace, static_rules<false, true>>;
+extern template struct basic_scenario<no_trace, static_rules<true, false>>;
+extern template struct basic_scenario<no_trace, static_rules<true, true>>;
 
-} // namespace blackjack
\ No newline at end of file
+} // namespace blackjack
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "outcome.hpp"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+
+namespace blackjack {
+
+enum class player_action
+    : std::uint8_t
+{
+    hit,
+    stick,
+    double_down,
+    split,
+};
+
+inline auto
+operator<<(
+    std::ostream &os,
+    player_action pa) -> std::ostream &
+{
+    switch (pa)
+    {
+    case player_action::double_down:os << "double down";
+        break;
+    case player_action::hit:os << "hit";
+        break;
+    case player_action::stick:os << "stick";
+        break;
+    case player_action::split:os << "split";
+        break;
+    }
+
+    return os;
+}
+
+struct scenario_result
+    : outcome
+{
+    scenario_result(player_action action)
+        : outcome()
+        , action(action)
+    {}
+
+    player_action action;
+
+    friend auto
+    operator<<(
+        std::ostream &os,
+        scenario_result const &sr)
+    -> std::ostream &
+    {
+        os << sr.action << " : pays " << sr.payoff();
+        if (sr.error > 0)
+            os << " +/- " << sr.error / sr.invested;
+        return os;
+    }
+
+};
+
+/// A scenario_result as the memo tables and snapshots keep it: 24 bytes
+/// rather than 40. A memoized result always has probability one, so that
+/// is not stored, and the error bound is kept in single precision, rounded
+/// up so that it is still a bound.
+struct memo_result
+{
+    memo_result() = default;
+
+    explicit memo_result(scenario_result const &r)
+        : invested(r.invested)
+        , returned(r.returned)
+        , error(float(r.error))
+        , action(r.action)
+    {
+        if (double(error) < r.error)
+            error = std::nextafter(error, std::numeric_limits<float>::infinity());
+    }
+
+    auto
+    result() const -> scenario_result
+    {
+        auto r = scenario_result(action);
+        r.invested = invested;
+        r.returned = returned;
+        r.error = error;
+        return r;
+    }
+
+    double invested = 1;
+    double returned = 0;
+    float error = 0;
+    player_action action = player_action::stick;
+};
+
+static_assert(sizeof(memo_result) == 24);
+
+} // namespace blackjack
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "polyfill/flat_memo.hpp"
+#include <cstdint>
+#include <ostream>
+
+namespace blackjack {
+
+/// Lookups in one memo table, and where they were answered.
+struct memo_counters
+{
+    std::uint64_t lookups = 0;
+    std::uint64_t hits = 0;          // found in the in-memory table
+    std::uint64_t snapshot_hits = 0; // found in the mapped snapshot
+
+    std::uint64_t
+    misses() const
+    { return lookups - hits - snapshot_hits; }
+
+    double
+    hit_rate() const
+    { return lookups ? double(hits + snapshot_hits) / double(lookups) : 0.0; }
+
+    friend auto
+    operator-(
+        memo_counters a,
+        memo_counters const &b) -> memo_counters
+    {
+        a.lookups -= b.lookups;
+        a.hits -= b.hits;
+        a.snapshot_hits -= b.snapshot_hits;
+        return a;
+    }
+
+    friend auto
+    operator<<(
+        std::ostream &os,
+        memo_counters const &c) -> std::ostream &
+    {
+        auto flags = os.flags();
+        auto precision = os.precision(4);
+        os << c.lookups << " lookups, " << c.hits << " hits, " << c.snapshot_hits
+           << " snapshot hits, " << c.misses() << " misses ("
+           << c.hit_rate() * 100 << "% hit rate)";
+        os.precision(precision);
+        os.flags(flags);
+        return os;
+    }
+};
+
+/// Work done by the exact engine. The counters accumulate over the
+/// engine's lifetime, so the difference of two snapshots is the work of
+/// whatever ran in between; the table occupancy is always that of the
+/// later snapshot.
+struct scenario_stats
+{
+    memo_counters player;
+    memo_counters dealer;
+
+    /// player states whose actions were evaluated
+    std::uint64_t player_nodes = 0;
+
+    /// dealer states expanded by the dealer's recursion
+    std::uint64_t dealer_nodes = 0;
+
+    /// player and dealer states left out for being less likely than the
+    /// engine's epsilon
+    std::uint64_t player_pruned = 0;
+    std::uint64_t dealer_pruned = 0;
+
+    polyfill::memo_occupancy player_table;
+    polyfill::memo_occupancy dealer_table;
+
+    friend auto
+    operator-(
+        scenario_stats a,
+        scenario_stats const &b) -> scenario_stats
+    {
+        a.player = a.player - b.player;
+        a.dealer = a.dealer - b.dealer;
+        a.player_nodes -= b.player_nodes;
+        a.dealer_nodes -= b.dealer_nodes;
+        a.player_pruned -= b.player_pruned;
+        a.dealer_pruned -= b.dealer_pruned;
+        return a;
+    }
+
+    friend auto
+    operator<<(
+        std::ostream &os,
+        scenario_stats const &s) -> std::ostream &
+    {
+        auto table = [&os](polyfill::memo_occupancy const &o) {
+            os << o.entries << " entries, " << o.bytes << " of " << o.budget
+               << " bytes, " << o.rotations << " rotations, " << o.evicted << " evicted";
+        };
+        os << "player memo : " << s.player
+           << "\n              ";
+        table(s.player_table);
+        os << "\ndealer memo : " << s.dealer
+           << "\n              ";
+        table(s.dealer_table);
+        os << "\nplayer nodes: " << s.player_nodes
+           << "\ndealer nodes: " << s.dealer_nodes;
+        if (s.player_pruned or s.dealer_pruned)
+            os << "\npruned      : " << s.player_pruned << " player, "
+               << s.dealer_pruned << " dealer";
+        return os;
+    }
+};
+
+} // namespace blackjack
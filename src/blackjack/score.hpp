@@ -1,49 +1,62 @@
 #pragma once
 
 #include "cards.hpp"
+#include "player_hand.hpp"
 #include <ostream>
 
 namespace blackjack {
 
 struct score
 {
-    score(cards const &cards_) : value_(0)
-        , soft_(false)
-        , blackjack_(false)
+    /// O(1): the cards keep their hard total and count as they change. An
+    /// ace counts eleven while that does not bust the hand; the only two
+    /// cards with a hard total of 11 and an ace are a blackjack.
+    score(cards const &cards_) : value_(cards_.hard_total())
+        , soft_(cards_[card_scale::ace] != 0)
+        , blackjack_(soft_ and cards_.count() == 2 and value_ == 11)
     {
-      if (cards_.count() == 2 and cards_[card_scale::ace] == 1 and
-          cards_[card_scale::ten] == 1)
+      if (blackjack_)
       {
         value_ = 21;
-        blackjack_ = true;
-        return;
+        soft_ = false;
       }
+      else if (soft_)
+        value_ += 10;
+    }
 
-      auto current_value = 2;
-      for (auto &&ncards : cards_)
-      {
-        value_ += current_value++ * ncards;
-      }
-      if (auto ace_count = cards_[card_scale::ace])
-      {
-        soft_ = true;
-        value_ -= 10 * (ace_count - 1);
-      }
+    /// A player's hand scores like any other, except that an ace and a ten
+    /// after a split make a soft 21 rather than a blackjack.
+    score(player_hand const &hand) : score(static_cast<cards const &>(hand))
+    {
+        if (blackjack_ and hand.after_split())
+        {
+            blackjack_ = false;
+            soft_ = true;
+        }
     }
 
-    int
+    constexpr score(
+        int value,
+        bool soft,
+        bool blackjack)
+        : value_(value)
+        , soft_(soft)
+        , blackjack_(blackjack)
+    {}
+
+    constexpr int
     value() const
     { return (value_ > 21 && soft_) ? value_ - 10 : value_; }
 
-    bool
+    constexpr bool
     bust() const
     { return value() > 21; }
 
-    bool
+    constexpr bool
     soft() const
     { return soft_ and value_ <= 21; }
 
-    bool
+    constexpr bool
     blackjack() const
     { return blackjack_; }
 
@@ -80,4 +93,14 @@ private:
     bool blackjack_;
 };
 
+/// The score of a hand with hard total `hard` that contains an ace iff
+/// `ace`, as score(cards const&) would compute it for a non-blackjack hand.
+constexpr auto
+hard_score(
+    int hard,
+    bool ace) -> score
+{
+    return score(ace ? hard + 10 : hard, ace, false);
+}
+
 } // namespace blackjack
\ No newline at end of file
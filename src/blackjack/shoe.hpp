@@ -7,6 +7,10 @@
 
 namespace blackjack {
 
+/// The most decks a shoe can hold: sixteen tens a deck must stay within
+/// max_rank_count.
+constexpr int max_decks = max_rank_count / 16;
+
 struct shoe
     : cards
 {
@@ -16,6 +20,7 @@ struct shoe
         : cards()
         , cards_behind_cut(cards_behind_cut)
     {
+        assert(decks <= std::size_t(max_decks));
         adjust(card_scale::two, 4 * decks);
         adjust(card_scale::three, 4 * decks);
         adjust(card_scale::four, 4 * decks);
@@ -0,0 +1,386 @@
+#pragma once
+
+#include "infinite_deck.hpp"
+#include "polyfill/parallel_for.hpp"
+#include "polyfill/random.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace blackjack {
+
+/// The action to take in every (up-card, hard total, holds ace) state, the
+/// actions for hands that came from a split, and which pairs to split.
+/// Like rules::may_double(), doubling is open whenever hitting is, so a
+/// hand that did not come from a split needs no fallback.
+struct strategy_table
+{
+    template<class T>
+    using by_state = infinite_deck_tables::by_state<T>;
+
+    by_state<player_action> action {};
+    by_state<player_action> after_split {};
+    std::array<std::array<bool, nof_card_scales>, nof_card_scales> split {};
+
+    static auto
+    from(infinite_deck_tables const &t) -> strategy_table
+    {
+        auto result = strategy_table();
+        for (std::size_t up = 0 ; up < nof_card_scales ; ++up)
+            for (int hard = 0 ; hard < infinite_deck_tables::nof_totals ; ++hard)
+                for (int ace = 0 ; ace < 2 ; ++ace)
+                {
+                    auto const &stick = t.stick[up][hard][ace];
+                    auto const &hit = t.hit[up][hard][ace];
+                    auto const &dbl = t.double_down[up][hard][ace];
+                    auto simple = hit.pnl() > stick.pnl() ? player_action::hit
+                                                          : player_action::stick;
+                    auto simple_pnl = std::max(hit.pnl(), stick.pnl());
+                    result.action[up][hard][ace] =
+                        dbl.pnl() > simple_pnl ? player_action::double_down : simple;
+
+                    auto const &split_hit = t.split_hit[up][hard][ace];
+                    auto split_simple = split_hit.pnl() > stick.pnl() ? player_action::hit
+                                                                      : player_action::stick;
+                    auto split_pnl = std::max(split_hit.pnl(), stick.pnl());
+                    result.after_split[up][hard][ace] =
+                        t.double_after_split and dbl.pnl() > split_pnl
+                        ? player_action::double_down : split_simple;
+                }
+        for (std::size_t up = 0 ; up < nof_card_scales ; ++up)
+            for (auto pair : all_card_faces())
+            {
+                auto hard = 2 * hard_value(pair);
+                auto ace = pair == card_scale::ace;
+                result.split[up][to_index(pair)] =
+                    t.split[up][to_index(pair)].pnl() > t.best[up][hard][ace].pnl();
+            }
+        return result;
+    }
+
+    static auto
+    basic(rules const &r) -> strategy_table
+    {
+        return from(infinite_deck_scenario::tables_for(r));
+    }
+
+    player_action
+    decide(
+        card_scale up,
+        int hard,
+        bool ace) const
+    {
+        return action[to_index(up)][hard][ace];
+    }
+
+    player_action
+    decide_after_split(
+        card_scale up,
+        int hard,
+        bool ace) const
+    {
+        return after_split[to_index(up)][hard][ace];
+    }
+
+    bool
+    splits(
+        card_scale up,
+        card_scale pair) const
+    {
+        return split[to_index(up)][to_index(pair)];
+    }
+};
+
+/// A physical shoe for simulation. Undealt cards occupy [0, remaining_) of
+/// the array; each draw picks one of them uniformly and swaps it to the
+/// end of that range (an incremental Fisher-Yates shuffle), so drawing is
+/// O(1) and the rank probabilities track exactly what has left the shoe.
+struct dealing_shoe
+{
+    dealing_shoe(
+        int decks,
+        int cards_behind_cut)
+        : cards_behind_cut_(cards_behind_cut)
+    {
+        auto s = shoe(decks);
+        for (auto c : all_card_faces())
+            cards_.insert(cards_.end(), s.count(c), c);
+        remaining_ = cards_.size();
+    }
+
+    /// Draws a card. Like shoe::exhausted(), reaching the cut card shuffles
+    /// the discards back in, but not the cards of the round in progress.
+    card_scale
+    draw(polyfill::xoshiro256 &rng)
+    {
+        if (remaining_ == std::size_t(cards_behind_cut_))
+            reshuffle();
+        auto j = rng.bounded(static_cast<std::uint32_t>(remaining_));
+        --remaining_;
+        std::swap(cards_[j], cards_[remaining_]);
+        ++in_play_;
+        return cards_[remaining_];
+    }
+
+    /// The cards of the finished round join the discards.
+    void
+    end_round()
+    { in_play_ = 0; }
+
+private:
+    void
+    reshuffle()
+    {
+        // move the cards in play behind the discards, then take the
+        // discards back
+        auto first = cards_.begin() + remaining_;
+        std::rotate(first, first + in_play_, cards_.end());
+        remaining_ = cards_.size() - in_play_;
+    }
+
+    std::vector<card_scale> cards_;
+    std::size_t remaining_ = 0;
+    std::size_t in_play_ = 0;
+    int cards_behind_cut_;
+};
+
+/// Mean and spread of the player's net win per round, in initial bets.
+struct simulation_result
+{
+    std::uint64_t rounds = 0;
+    double sum = 0.0;
+    double sum_of_squares = 0.0;
+    double seconds = 0.0;
+
+    double
+    mean() const
+    { return rounds ? sum / double(rounds) : 0.0; }
+
+    double
+    variance() const
+    {
+        if (rounds < 2)
+            return 0.0;
+        auto m = mean();
+        return (sum_of_squares - double(rounds) * m * m) / double(rounds - 1);
+    }
+
+    double
+    standard_error() const
+    { return rounds ? std::sqrt(variance() / double(rounds)) : 0.0; }
+
+    /// The house edge: the casino's expected win per initial bet.
+    double
+    house_edge() const
+    { return -mean(); }
+
+    /// Half-width of the confidence interval on the house edge, for a
+    /// normal quantile z (1.96 for 95%).
+    double
+    confidence_half_width(double z = 1.96) const
+    { return z * standard_error(); }
+
+    simulation_result &
+    operator+=(simulation_result const &other)
+    {
+        rounds += other.rounds;
+        sum += other.sum;
+        sum_of_squares += other.sum_of_squares;
+        return *this;
+    }
+
+    friend std::ostream &
+    operator<<(
+        std::ostream &os,
+        simulation_result const &r)
+    {
+        auto flags = os.flags();
+        auto precision = os.precision();
+        os << "rounds: " << r.rounds
+           << "\nhouse edge: " << polyfill::percentage(r.house_edge())
+           << " +/- " << polyfill::percentage(r.confidence_half_width()) << " (95%)"
+           << "\nstandard deviation per round: " << std::sqrt(r.variance())
+           << "\nrounds per second: " << std::setprecision(4)
+           << (r.seconds > 0 ? double(r.rounds) / r.seconds : 0.0);
+        os.precision(precision);
+        os.flags(flags);
+        return os;
+    }
+};
+
+/// Plays rounds against the rules with a fixed strategy table.
+struct simulator
+{
+    simulator(
+        rules const &r,
+        strategy_table const &strategy)
+        : rules_(r)
+        , strategy_(strategy)
+    {}
+
+    /// Plays `rounds` rounds from one freshly shuffled shoe.
+    auto
+    play(
+        std::uint64_t rounds,
+        polyfill::xoshiro256 &rng) const -> simulation_result
+    {
+        auto result = simulation_result();
+        auto s = dealing_shoe(rules_.no_of_decks, rules_.cards_behind_cut);
+        for (std::uint64_t i = 0 ; i < rounds ; ++i)
+        {
+            auto net = play_round(s, rng);
+            result.sum += net;
+            result.sum_of_squares += net * net;
+            s.end_round();
+        }
+        result.rounds = rounds;
+        return result;
+    }
+
+    /// Splits the rounds over `threads` workers, each with its own shoe and
+    /// a generator seeded from `seed` and its index, so a run is
+    /// reproducible for a given seed and thread count.
+    auto
+    run(
+        std::uint64_t rounds,
+        std::size_t threads,
+        std::uint64_t seed) const -> simulation_result
+    {
+        threads = std::max<std::size_t>(1, threads);
+        auto parts = std::vector<simulation_result>(threads);
+        auto start = std::chrono::steady_clock::now();
+        polyfill::parallel_for(threads, threads, [&](
+            std::size_t,
+            std::size_t i) {
+            auto stream = seed + i;
+            auto rng = polyfill::xoshiro256(polyfill::splitmix64(stream));
+            auto share = rounds / threads + (i < rounds % threads ? 1 : 0);
+            parts[i] = play(share, rng);
+        });
+        auto result = simulation_result();
+        for (auto &&p : parts)
+            result += p;
+        result.seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+private:
+    struct hand_state
+    {
+        int hard = 0;
+        bool ace = false;
+        int count = 0;
+        bool natural = false;
+        bool after_split = false;
+
+        void
+        add(card_scale c)
+        {
+            hard += hard_value(c);
+            ace = ace or c == card_scale::ace;
+            ++count;
+            natural = count == 2 and hard == 11 and ace and not after_split;
+        }
+
+        auto
+        to_score() const -> score
+        {
+            return natural ? score(21, true, true) : hard_score(hard, ace);
+        }
+    };
+
+    /// Plays the player's hand to the end and returns the stake on it.
+    double
+    play_hand(
+        dealing_shoe &s,
+        polyfill::xoshiro256 &rng,
+        card_scale up,
+        hand_state &player) const
+    {
+        double stake = 1.0;
+        if (player.natural)
+            return stake;
+        for (;;)
+        {
+            auto action = player.after_split
+                          ? strategy_.decide_after_split(up, player.hard, player.ace)
+                          : strategy_.decide(up, player.hard, player.ace);
+            if (action == player_action::stick)
+                break;
+            player.add(s.draw(rng));
+            if (action == player_action::double_down)
+            {
+                stake = 2.0;
+                break;
+            }
+            if (player.to_score().bust())
+                break;
+        }
+        return stake;
+    }
+
+    /// The player's net win for one round, in initial bets.
+    double
+    play_round(
+        dealing_shoe &s,
+        polyfill::xoshiro256 &rng) const
+    {
+        auto player = hand_state();
+        auto dealer = hand_state();
+        auto first = s.draw(rng);
+        player.add(first);
+        auto up = s.draw(rng);
+        dealer.add(up);
+        auto second = s.draw(rng);
+        player.add(second);
+
+        // a split pair becomes two hands of one card, each dealt a second
+        // card and played on in turn
+        std::array<hand_state, 2> hands;
+        std::array<double, 2> stakes {};
+        std::size_t nof_hands = 1;
+        if (first == second and strategy_.splits(up, first))
+        {
+            nof_hands = 2;
+            for (auto &h : hands)
+            {
+                h.after_split = true;
+                h.add(first);
+                h.add(s.draw(rng));
+            }
+        }
+        else
+            hands[0] = player;
+
+        auto standing = false;
+        for (std::size_t i = 0 ; i < nof_hands ; ++i)
+        {
+            stakes[i] = play_hand(s, rng, up, hands[i]);
+            standing = standing or not hands[i].to_score().bust();
+        }
+
+        if (standing)
+            while (rules_.select_dealer_action(dealer.to_score()) == dealer_action::hit)
+                dealer.add(s.draw(rng));
+
+        double net = 0.0;
+        for (std::size_t i = 0 ; i < nof_hands ; ++i)
+        {
+            auto player_score = hands[i].to_score();
+            if (player_score.bust())
+                net -= stakes[i];
+            else
+                net += stakes[i] * (rules_.payoff(player_score, dealer.to_score()) - 1.0);
+        }
+        return net;
+    }
+
+    rules const &rules_;
+    strategy_table strategy_;
+};
+
+} // namespace blackjack
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "initial_deals.hpp"
+#include "scenario.hpp"
+#include "polyfill/cancellation.hpp"
+#include <algorithm>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace blackjack {
+
+/// Warms an engine's memo tables on a background thread with the initial
+/// deals the next round can bring, most likely first, so that the next
+/// suggestion is usually a memo hit.
+///
+/// The engine is not shared: the worker owns it between start() and
+/// stop(), and stop() cancels the pass and joins the worker before the
+/// caller touches the engine again. For that, the speculator attaches its
+/// cancellation token to the engine for as long as it lives, and then
+/// gives the engine back the token it had.
+template<class Engine = scenario>
+class speculator
+{
+public:
+    explicit speculator(Engine &engine)
+        : engine_(engine)
+        , previous_cancel_(engine_.set_cancellation(&cancel_))
+    {
+    }
+
+    speculator(speculator const &) = delete;
+    speculator &operator=(speculator const &) = delete;
+
+    ~speculator()
+    {
+        stop();
+        engine_.set_cancellation(previous_cancel_);
+    }
+
+    /// Starts evaluating the deals from `s`, with the cards of the round
+    /// just played already added to `burn_pile`. If dealing three cards
+    /// would reach the cut card, the shoe reshuffles first and nothing
+    /// worthwhile can be precomputed, so no pass is started.
+    void
+    start(
+        shoe const &s,
+        cards const &burn_pile)
+    {
+        stop();
+        if (s.count() - s.cards_behind_cut < 3)
+            return;
+        worker_ = std::thread([this, s, burn_pile] {
+            try
+            {
+                for (auto &&d : likely_deals(s))
+                {
+                    auto s2 = s;
+                    s2 -= d.p1;
+                    s2 -= d.p2;
+                    s2 -= d.d;
+                    engine_.run(s2, player_hand(d.p1, d.p2), dealer_hand(d.d), burn_pile);
+                }
+            }
+            catch (polyfill::operation_cancelled const &)
+            {
+            }
+        });
+    }
+
+    /// Cancels the pass in progress, if any, and waits for the worker to
+    /// leave the engine.
+    void
+    stop()
+    {
+        if (!worker_.joinable())
+            return;
+        cancel_.cancel();
+        worker_.join();
+        cancel_.reset();
+    }
+
+private:
+    /// The distinct deals (unordered player cards, up-card) that `s` can
+    /// produce, most probable first.
+    static auto
+    likely_deals(shoe const &s) -> std::vector<initial_deal>
+    {
+        auto weighted = std::vector<std::pair<double, initial_deal>>();
+        for (std::size_t i = 0 ; i < nof_initial_deals ; ++i)
+        {
+            auto deal = initial_deal::from_index(i);
+            if (deal.p1 > deal.p2)
+                continue;
+            auto left = s;
+            auto prob = 1.0;
+            for (auto c : { deal.p1, deal.d, deal.p2 })
+            {
+                prob *= left.probability(c);
+                if (left[c])
+                    left -= c;
+            }
+            if (prob > 0)
+                weighted.emplace_back(prob, deal);
+        }
+        std::stable_sort(weighted.begin(), weighted.end(), [](
+            auto const &a,
+            auto const &b) {
+            return a.first > b.first;
+        });
+        auto result = std::vector<initial_deal>();
+        for (auto &&w : weighted)
+            result.push_back(w.second);
+        return result;
+    }
+
+    Engine &engine_;
+    polyfill::cancellation_token cancel_;
+    polyfill::cancellation_token const *previous_cancel_;
+    std::thread worker_;
+};
+
+} // namespace blackjack
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "cards.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+
+namespace blackjack {
+
+/// A fixed-width, bit-packed memo key.
+/// Equality is a handful of integer compares and hashing mixes whole words,
+/// so probing a memo table never walks card arrays element by element.
+template<std::size_t Words>
+struct packed_key
+{
+    static constexpr std::size_t nof_words = Words;
+
+    std::array<std::uint64_t, Words> words{};
+
+    friend bool
+    operator==(
+        packed_key const &a,
+        packed_key const &b)
+    {
+        return a.words == b.words;
+    }
+
+    friend bool
+    operator!=(
+        packed_key const &a,
+        packed_key const &b)
+    {
+        return not(a == b);
+    }
+
+    /// Deterministic across processes (no per-run seed), which keeps
+    /// table layouts reproducible.
+    friend std::size_t
+    hash_value(packed_key const &k)
+    {
+        std::uint64_t h = 0x9e3779b97f4a7c15ull;
+        for (auto w : k.words)
+        {
+            h ^= w;
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdull;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ull;
+            h ^= h >> 33;
+        }
+        return static_cast<std::size_t>(h);
+    }
+};
+
+/// Field widths. A hand's hard total stays below 32 (a dealer's below 27),
+/// a pair rank is stored plus one so that zero means none, and with up to
+/// 15 decks no rank in a shoe or burn pile exceeds 255. A pruned search is
+/// keyed by the reach it was searched at, rounded to 2^-n with n below 64.
+constexpr unsigned hand_total_bits = 5;
+constexpr unsigned hand_size_bits = 2;
+constexpr unsigned pair_rank_bits = 4;
+constexpr unsigned shoe_rank_bits = 8;
+constexpr unsigned cut_bits = 12;
+constexpr unsigned reach_bits = 6;
+
+/// Appends fixed-width fields to a packed_key, low bits first.
+template<std::size_t Words>
+struct key_packer
+{
+    void
+    push(
+        std::uint64_t value,
+        unsigned bits)
+    {
+        assert(bits > 0 and bits <= 64);
+        assert(bits == 64 or value < (std::uint64_t(1) << bits));
+        assert(pos_ + bits <= Words * 64);
+
+        auto word = pos_ / 64;
+        auto shift = pos_ % 64;
+        key_.words[word] |= value << shift;
+        if (shift + bits > 64)
+            key_.words[word + 1] |= value >> (64 - shift);
+        pos_ += bits;
+    }
+
+    void
+    push(bool flag)
+    {
+        push(flag ? 1 : 0, 1);
+    }
+
+    void
+    push(
+        cards const &c,
+        unsigned bits_per_rank)
+    {
+        for (auto n : c)
+            push(static_cast<std::uint64_t>(n), bits_per_rank);
+    }
+
+    /// Pushes what a hand's play depends on once the shoe is known: its
+    /// hard total, whether it holds an ace, and its size up to three, as
+    /// only hands of one or two cards are special. Hands that differ only in
+    /// how they reached their total get the same fields.
+    void
+    push_hand_state(cards const &h)
+    {
+        push(static_cast<std::uint64_t>(h.hard_total()), hand_total_bits);
+        push(h[card_scale::ace] != 0);
+        push(static_cast<std::uint64_t>(std::min(h.count(), 3)), hand_size_bits);
+    }
+
+    packed_key<Words> const &
+    key() const
+    {
+        return key_;
+    }
+
+private:
+    packed_key<Words> key_;
+    unsigned pos_ = 0;
+};
+
+/// Memo keys: player hand state, after split, the rank of a pair that may
+/// be split, dealer hand state, shoe, cut, burn pile and reach for player
+/// decisions; dealer hand state, shoe, cut, burn pile and reach for the
+/// dealer's draw. The cards the hands hold are gone from the shoe, which is
+/// all the future depends on, so hands only contribute the fields of
+/// push_hand_state. Where the cut card is out of reach the burn pile is
+/// left empty and the cut zero; an exhausted shoe has the burn pile merged
+/// in. Without pruning the reach is always zero.
+using player_state_key = packed_key<4>;
+using dealer_state_key = packed_key<3>;
+
+/// Bump whenever the meaning or layout of the state keys, or of the values
+/// stored under them, changes, so that
+/// persisted memo snapshots built with the old layout are rejected.
+constexpr std::uint32_t memo_layout_version = 8;
+
+} // namespace blackjack
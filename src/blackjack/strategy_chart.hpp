@@ -0,0 +1,267 @@
+#pragma once
+
+#include "anytime.hpp"
+#include "scenario.hpp"
+#include "polyfill/parallel_for.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+namespace blackjack {
+
+enum class chart_section
+{
+    hard,
+    soft,
+    pair
+};
+
+inline auto
+operator<<(
+    std::ostream &os,
+    chart_section cs) -> std::ostream &
+{
+    switch (cs)
+    {
+    case chart_section::hard: return os << "hard";
+    case chart_section::soft: return os << "soft";
+    case chart_section::pair: return os << "pair";
+    }
+    return os;
+}
+
+/// One cell of a strategy chart: a two-card player hand against a dealer
+/// up-card, with the outcome of every action the rules allow.
+struct chart_entry
+{
+    chart_entry(
+        chart_section section,
+        player_hand hand,
+        card_scale up)
+        : section(section)
+        , hand(std::move(hand))
+        , up(up)
+        , best(player_action::stick)
+    {}
+
+    chart_section section;
+    player_hand hand;
+    card_scale up;
+    scenario::result_vector results;
+    scenario_result best;
+
+    /// how far an engine with a time budget got with this cell
+    std::optional<anytime_progress> progress;
+
+    /// The hand's total, as shown on the chart row.
+    auto
+    total() const -> int
+    {
+        return score(hand).value();
+    }
+};
+
+using strategy_chart = std::vector<chart_entry>;
+
+/// The chart's rows, one representative two-card hand each: hard 5 to 19
+/// (without pairs), soft 13 to 20 and every pair.
+inline auto
+chart_hands() -> std::vector<std::pair<chart_section, player_hand>>
+{
+    auto result = std::vector<std::pair<chart_section, player_hand>>();
+    for (int total = 5 ; total <= 19 ; ++total)
+    {
+        auto high = std::min(10, total - 2);
+        auto low = total - high;
+        result.emplace_back(chart_section::hard,
+                            player_hand(to_card_scale(high - 2), to_card_scale(low - 2)));
+    }
+    for (auto c = card_scale::two ; c <= card_scale::nine ; c = to_card_scale(c + 1))
+        result.emplace_back(chart_section::soft, player_hand(card_scale::ace, c));
+    for (auto c : all_card_faces())
+        result.emplace_back(chart_section::pair, player_hand(c, c));
+    return result;
+}
+
+/// Evaluates every chart hand against every up-card dealt from a fresh shoe
+/// for `r`, spreading the cells over `threads` workers with one Engine each,
+/// all sharing one set of memo tables (those in `opts`, if any). As with
+/// iterate_all(), the chart is the same for any thread count. If `collect`
+/// is given, the memo tables are added to it.
+template<class Engine = scenario>
+auto
+make_strategy_chart(
+    rules const &r,
+    std::size_t threads,
+    scenario_options const &opts = scenario_options(),
+    snapshot_builder *collect = nullptr) -> strategy_chart
+{
+    auto chart = strategy_chart();
+    for (auto &&[section, hand] : chart_hands())
+        for (auto up : all_card_faces())
+            chart.emplace_back(section, hand, up);
+
+    threads = std::max<std::size_t>(1, std::min(threads, chart.size()));
+    auto worker_opts = opts;
+    if (!worker_opts.tables)
+        worker_opts.tables = std::make_shared<scenario_tables>(opts.memo_bytes);
+    auto workers = std::vector<std::unique_ptr<Engine>>();
+    for (std::size_t w = 0 ; w < threads ; ++w)
+        workers.push_back(std::make_unique<Engine>(r, worker_opts));
+
+    auto const fresh = shoe(r.no_of_decks, r.cards_behind_cut);
+    polyfill::parallel_for(chart.size(), threads, [&](
+        std::size_t w,
+        std::size_t i) {
+        auto &entry = chart[i];
+        auto s = fresh;
+        for (auto c : all_card_faces())
+            for (auto n = entry.hand[c] ; n-- ; )
+                s -= c;
+        s -= entry.up;
+        entry.results = workers[w]->evaluate(s, entry.hand, dealer_hand(entry.up), cards());
+        entry.best = scenario::best_of(entry.results);
+        entry.progress = last_progress(*workers[w]);
+    });
+
+    // the workers share their tables, so one of them has every entry
+    if (collect)
+        collect->add(*workers.front());
+
+    return chart;
+}
+
+namespace detail {
+
+inline auto
+chart_action_name(player_action pa) -> const char *
+{
+    switch (pa)
+    {
+    case player_action::stick: return "stick";
+    case player_action::hit: return "hit";
+    case player_action::double_down: return "double";
+    case player_action::split: return "split";
+    }
+    return "?";
+}
+
+constexpr player_action chart_actions[] = {
+    player_action::stick,
+    player_action::hit,
+    player_action::double_down,
+    player_action::split
+};
+
+inline auto
+find_result(
+    chart_entry const &e,
+    player_action pa) -> scenario_result const *
+{
+    for (auto &&r : e.results)
+        if (r.action == pa)
+            return &r;
+    return nullptr;
+}
+
+inline auto
+has_progress(strategy_chart const &chart) -> bool
+{
+    return std::any_of(chart.begin(), chart.end(), [](chart_entry const &e) {
+        return e.progress.has_value();
+    });
+}
+
+} // namespace detail
+
+/// One line per cell. The ev_ columns hold the expected net win per initial
+/// unit bet, and are empty where the action is not allowed. A chart made by
+/// an engine with a time budget also has the columns of its
+/// anytime_progress: searches finished, the epsilon of the last (empty if
+/// none, when the values are the approximation's) and whether it was the
+/// final one.
+inline void
+write_csv(
+    std::ostream &os,
+    strategy_chart const &chart)
+{
+    auto flags = os.flags();
+    auto precision = os.precision(8);
+    auto progress = detail::has_progress(chart);
+    os << "section,total,hand,upcard,best";
+    for (auto pa : detail::chart_actions)
+        os << ",ev_" << detail::chart_action_name(pa);
+    if (progress)
+        os << ",searches,epsilon,final";
+    os << '\n';
+    for (auto &&e : chart)
+    {
+        os << e.section << ',' << e.total() << ',' << e.hand << ',' << e.up << ','
+           << detail::chart_action_name(e.best.action);
+        for (auto pa : detail::chart_actions)
+        {
+            os << ',';
+            if (auto *r = detail::find_result(e, pa))
+                os << r->pnl();
+        }
+        if (e.progress)
+        {
+            os << ',' << e.progress->searches << ',';
+            if (e.progress->searches)
+                os << e.progress->epsilon;
+            os << ',' << e.progress->final;
+        }
+        else if (progress)
+            os << ",,,";
+        os << '\n';
+    }
+    os.precision(precision);
+    os.flags(flags);
+}
+
+/// A JSON array with one object per cell; actions that are not allowed are
+/// left out of "ev". A cell made by an engine with a time budget also has
+/// "searches", "epsilon" (null if none finished) and "final".
+inline void
+write_json(
+    std::ostream &os,
+    strategy_chart const &chart)
+{
+    auto flags = os.flags();
+    auto precision = os.precision(8);
+    os << "[\n";
+    auto sep = "";
+    for (auto &&e : chart)
+    {
+        os << sep << "  {\"section\":\"" << e.section << "\",\"total\":" << e.total()
+           << ",\"hand\":\"" << e.hand << "\",\"upcard\":\"" << e.up
+           << "\",\"best\":\"" << detail::chart_action_name(e.best.action) << "\",\"ev\":{";
+        auto ev_sep = "";
+        for (auto pa : detail::chart_actions)
+            if (auto *r = detail::find_result(e, pa))
+            {
+                os << ev_sep << '"' << detail::chart_action_name(pa) << "\":" << r->pnl();
+                ev_sep = ",";
+            }
+        os << '}';
+        if (e.progress)
+        {
+            os << ",\"searches\":" << e.progress->searches << ",\"epsilon\":";
+            if (e.progress->searches)
+                os << e.progress->epsilon;
+            else
+                os << "null";
+            os << ",\"final\":" << (e.progress->final ? "true" : "false");
+        }
+        os << '}';
+        sep = ",\n";
+    }
+    os << "\n]\n";
+    os.precision(precision);
+    os.flags(flags);
+}
+
+} // namespace blackjack
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <utility>
+
+namespace blackjack {
+
+/// Tracing policy for the production engine: contexts are empty and every
+/// trace call compiles away.
+struct no_trace
+{
+    static constexpr bool enabled = false;
+
+    struct context
+    {
+        friend std::ostream &
+        operator<<(
+            std::ostream &os,
+            context const &)
+        {
+            return os;
+        }
+
+        explicit context(char = ' ')
+        {}
+
+        explicit context(std::string const &)
+        {}
+
+        explicit context(const char *)
+        {}
+    };
+
+    static bool
+    recursing()
+    {
+        return false;
+    }
+};
+
+/// Tracing policy for explanations: each context appends a marker to a
+/// per-thread path string, which prefixes every line of the trace.
+struct full_trace
+{
+    static constexpr bool enabled = true;
+
+    struct context
+    {
+        friend std::ostream &
+        operator<<(
+            std::ostream &os,
+            context const &)
+        {
+            os << context_string_;
+            return os;
+        }
+
+        explicit context(char c = ' ')
+            : adjust_(1)
+        {
+            context_string_ += c;
+        }
+
+        explicit context(std::string const &s)
+            : adjust_(s.size())
+        {
+            context_string_ += s;
+        }
+
+        explicit context(const char *p)
+            : adjust_(std::strlen(p))
+        {
+            context_string_ += p;
+        }
+
+        context(context &&other)
+            : adjust_(std::exchange(other.adjust_, 0))
+        {
+        }
+
+        ~context()
+        {
+            context_string_.erase(context_string_.end() - adjust_, context_string_.end());
+        }
+
+        int adjust_;
+    };
+
+    static bool
+    recursing()
+    {
+        return !context_string_.empty();
+    }
+
+    static thread_local std::string context_string_;
+};
+
+thread_local inline std::string full_trace::context_string_ = "";
+
+} // namespace blackjack
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <mutex>
+
+namespace polyfill {
+
+/// Thrown out of a long computation whose cancellation_token was raised.
+struct operation_cancelled
+    : std::exception
+{
+    const char *
+    what() const noexcept override
+    { return "operation cancelled"; }
+};
+
+/// A flag raised by one thread and polled by a computation on another.
+/// The computation unwinds by throwing operation_cancelled, so it only
+/// needs checks at points where partial work can be dropped. The flag can
+/// also be set to raise itself at a deadline, which costs a clock read per
+/// poll while one is set.
+class cancellation_token
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    void
+    cancel()
+    { cancelled_.store(true, std::memory_order_relaxed); }
+
+    void
+    cancel_at(clock::time_point deadline)
+    { deadline_.store(deadline.time_since_epoch().count(), std::memory_order_relaxed); }
+
+    /// Lowers the flag and clears the deadline.
+    void
+    reset()
+    {
+        cancelled_.store(false, std::memory_order_relaxed);
+        deadline_.store(no_deadline, std::memory_order_relaxed);
+    }
+
+    bool
+    cancelled() const
+    {
+        if (cancelled_.load(std::memory_order_relaxed))
+            return true;
+        auto deadline = deadline_.load(std::memory_order_relaxed);
+        return deadline != no_deadline and clock::now().time_since_epoch().count() >= deadline;
+    }
+
+    void
+    throw_if_cancelled() const
+    {
+        if (cancelled())
+            throw operation_cancelled();
+    }
+
+    /// Waits on `cv` like cv.wait(lock), then throws operation_cancelled if
+    /// the flag is raised. Raising the flag does not notify `cv`, so the
+    /// wait ends by the deadline, if one is set, and after poll_interval
+    /// at the latest; callers wait in a loop, as for a spurious wakeup.
+    void
+    wait(
+        std::condition_variable &cv,
+        std::unique_lock<std::mutex> &lock) const
+    {
+        auto wake = clock::now() + poll_interval;
+        auto deadline = deadline_.load(std::memory_order_relaxed);
+        if (deadline != no_deadline)
+            wake = std::min(wake, clock::time_point(clock::duration(deadline)));
+        cv.wait_until(lock, wake);
+        throw_if_cancelled();
+    }
+
+    /// how often wait() looks at the flag
+    static constexpr auto poll_interval = std::chrono::milliseconds(1);
+
+private:
+    static constexpr auto no_deadline = std::numeric_limits<clock::rep>::max();
+
+    std::atomic<bool> cancelled_ { false };
+    std::atomic<clock::rep> deadline_ { no_deadline };
+};
+
+} // namespace polyfill
@@ -0,0 +1,284 @@
+#pragma once
+
+#include "universal.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace polyfill {
+
+/// Occupancy report for a flat_memo.
+struct memo_occupancy
+{
+    std::size_t entries = 0;      // live entries across both generations
+    std::size_t slots = 0;        // allocated slots across both generations
+    std::size_t bytes = 0;        // bytes held by the slot arenas
+    std::size_t budget = 0;       // configured byte budget
+    std::size_t rotations = 0;    // number of times the old generation was dropped
+    std::size_t evicted = 0;      // entries discarded by those rotations
+
+    double
+    load_factor() const
+    { return slots ? double(entries) / double(slots) : 0.0; }
+};
+
+/// A memory-bounded memo table.
+///
+/// Entries live in flat open-addressing tables (linear probing, one
+/// contiguous arena per table, a one-byte hash tag per slot), so a probe
+/// touches a control byte array and at most a few adjacent slots.
+///
+/// Eviction is generational: new entries go into the young table, which
+/// grows by doubling until it reaches half of the byte budget. When it fills
+/// up it becomes the old table and the previous old table is discarded.
+/// Entries found in the old table are promoted back into the young one, so
+/// anything in active use survives a rotation.
+///
+/// Keys and values must be trivially copyable; entries are never erased
+/// individually.
+template<class Key, class Value, class Hash = universal_hash,
+    class KeyEqual = universal_equal_to>
+class flat_memo
+{
+    static_assert(std::is_trivially_copyable_v<Key>);
+    static_assert(std::is_trivially_copyable_v<Value>);
+    static_assert(std::is_trivially_destructible_v<Key>);
+    static_assert(std::is_trivially_destructible_v<Value>);
+
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+
+    struct entry
+    {
+        Key key;
+        Value value;
+    };
+
+    static constexpr std::size_t slot_bytes = sizeof(entry) + 1;
+    static constexpr std::size_t min_slots = 1024;
+
+    explicit flat_memo(std::size_t budget_bytes = std::size_t(256) << 20)
+        : budget_(budget_bytes)
+    {
+        max_slots_ = min_slots;
+        while (max_slots_ * 2 * slot_bytes * 2 <= budget_)
+            max_slots_ *= 2;
+    }
+
+    flat_memo(flat_memo &&) = default;
+    flat_memo &operator=(flat_memo &&) = default;
+
+    /// Returns a pointer to the cached value or nullptr. The pointer is
+    /// invalidated by the next insertion.
+    Value const *
+    find(Key const &key)
+    {
+        auto h = hash_(key);
+        if (auto *e = young_.find(key, h, eq_))
+            return &e->value;
+        if (auto *e = old_.find(key, h, eq_))
+        {
+            // copy out before the promotion can rotate the old table away
+            auto promoted = *e;
+            return &insert_hashed(promoted.key, promoted.value, h);
+        }
+        return nullptr;
+    }
+
+    /// Inserts (or overwrites) an entry and returns a reference to the
+    /// stored value, valid until the next insertion.
+    Value const &
+    insert(
+        Key const &key,
+        Value const &value)
+    {
+        return insert_hashed(key, value, hash_(key));
+    }
+
+    void
+    clear()
+    {
+        young_.release();
+        old_.release();
+    }
+
+    std::size_t
+    size() const
+    { return young_.size + old_.size; }
+
+    std::size_t
+    budget() const
+    { return budget_; }
+
+    auto
+    occupancy() const -> memo_occupancy
+    {
+        auto result = memo_occupancy();
+        result.entries = size();
+        result.slots = young_.capacity + old_.capacity;
+        result.bytes = result.slots * slot_bytes;
+        result.budget = budget_;
+        result.rotations = rotations_;
+        result.evicted = evicted_;
+        return result;
+    }
+
+    /// Visits every live entry, young generation first.
+    template<class F>
+    void
+    for_each(F &&f) const
+    {
+        young_.for_each(f);
+        old_.for_each(f);
+    }
+
+private:
+    struct table
+    {
+        using storage = std::aligned_storage_t<sizeof(entry), alignof(entry)>;
+
+        std::unique_ptr<std::uint8_t[]> ctrl;
+        std::unique_ptr<storage[]> arena;
+        std::size_t capacity = 0;
+        std::size_t size = 0;
+
+        static std::uint8_t
+        tag(std::size_t h)
+        { return std::uint8_t(0x80 | (h >> (sizeof(std::size_t) * 8 - 7))); }
+
+        bool
+        full() const
+        { return size * 4 >= capacity * 3; }
+
+        entry *
+        find(
+            Key const &key,
+            std::size_t h,
+            KeyEqual const &eq) const
+        {
+            if (!capacity)
+                return nullptr;
+            auto mask = capacity - 1;
+            auto t = tag(h);
+            for (auto i = h & mask ; ctrl[i] ; i = (i + 1) & mask)
+                if (ctrl[i] == t && eq(slot(i).key, key))
+                    return &slot(i);
+            return nullptr;
+        }
+
+        entry &
+        insert(
+            Key const &key,
+            Value const &value,
+            std::size_t h,
+            KeyEqual const &eq)
+        {
+            auto mask = capacity - 1;
+            auto t = tag(h);
+            auto i = h & mask;
+            for (; ctrl[i] ; i = (i + 1) & mask)
+                if (ctrl[i] == t && eq(slot(i).key, key))
+                {
+                    slot(i).value = value;
+                    return slot(i);
+                }
+            ctrl[i] = t;
+            auto *e = new (&arena[i]) entry { key, value };
+            ++size;
+            return *e;
+        }
+
+        void
+        allocate(std::size_t n)
+        {
+            ctrl = std::make_unique<std::uint8_t[]>(n);
+            arena = std::make_unique<storage[]>(n);
+            capacity = n;
+            size = 0;
+        }
+
+        void
+        reset()
+        {
+            std::fill(ctrl.get(), ctrl.get() + capacity, std::uint8_t(0));
+            size = 0;
+        }
+
+        void
+        release()
+        {
+            ctrl.reset();
+            arena.reset();
+            capacity = 0;
+            size = 0;
+        }
+
+        template<class F>
+        void
+        for_each(F &&f) const
+        {
+            for (std::size_t i = 0 ; i < capacity ; ++i)
+                if (ctrl[i])
+                    f(slot(i).key, slot(i).value);
+        }
+
+        entry &
+        slot(std::size_t i) const
+        { return *std::launder(reinterpret_cast<entry *>(&arena[i])); }
+    };
+
+    Value const &
+    insert_hashed(
+        Key const &key,
+        Value const &value,
+        std::size_t h)
+    {
+        if (young_.capacity == 0)
+            young_.allocate(min_slots);
+        else if (young_.full())
+            make_room();
+        return young_.insert(key, value, h, eq_).value;
+    }
+
+    void
+    make_room()
+    {
+        if (young_.capacity < max_slots_)
+        {
+            auto bigger = table();
+            bigger.allocate(young_.capacity * 2);
+            young_.for_each([&](
+                Key const &k,
+                Value const &v) {
+                bigger.insert(k, v, hash_(k), eq_);
+            });
+            young_ = std::move(bigger);
+            return;
+        }
+
+        // young generation is at its ceiling: drop the old generation and
+        // recycle its arena for the new young generation
+        ++rotations_;
+        evicted_ += old_.size;
+        std::swap(young_, old_);
+        if (young_.capacity != max_slots_)
+            young_.allocate(max_slots_);
+        else
+            young_.reset();
+    }
+
+    std::size_t budget_;
+    std::size_t max_slots_;
+    table young_;
+    table old_;
+    std::size_t rotations_ = 0;
+    std::size_t evicted_ = 0;
+    Hash hash_;
+    KeyEqual eq_;
+};
+
+} // namespace polyfill
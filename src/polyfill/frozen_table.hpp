@@ -0,0 +1,148 @@
+#pragma once
+
+#include "universal.hpp"
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace polyfill {
+
+/// A read-only open-addressing hash table laid out so that it can be probed
+/// in place, e.g. straight out of a memory-mapped file:
+///
+///     [capacity control bytes][padding to 8][capacity entries]
+///
+/// Control bytes are 0 for an empty slot, otherwise a 7-bit hash tag with
+/// the top bit set. The hash must be deterministic across processes.
+template<class Key, class Value, class Hash = universal_hash,
+    class KeyEqual = universal_equal_to>
+struct frozen_table
+{
+    static_assert(std::is_trivially_copyable_v<Key>);
+    static_assert(std::is_trivially_copyable_v<Value>);
+
+    struct entry
+    {
+        Key key;
+        Value value;
+    };
+
+    static constexpr std::size_t
+    entries_offset(std::size_t capacity)
+    { return (capacity + 7) / 8 * 8; }
+
+    static constexpr std::size_t
+    image_bytes(std::size_t capacity)
+    { return entries_offset(capacity) + capacity * sizeof(entry); }
+
+    static std::uint8_t
+    tag(std::size_t h)
+    { return std::uint8_t(0x80 | (h >> (sizeof(std::size_t) * 8 - 7))); }
+
+    /// A view over an image produced by builder::build().
+    struct view
+    {
+        view() = default;
+
+        view(
+            void const *image,
+            std::size_t capacity,
+            std::size_t size)
+            : ctrl_(static_cast<std::uint8_t const *>(image))
+            , entries_(reinterpret_cast<entry const *>(ctrl_ + entries_offset(capacity)))
+            , capacity_(capacity)
+            , size_(size)
+        {}
+
+        Value const *
+        find(Key const &key) const
+        {
+            if (!capacity_)
+                return nullptr;
+            auto h = Hash()(key);
+            auto mask = capacity_ - 1;
+            auto t = tag(h);
+            for (auto i = h & mask ; ctrl_[i] ; i = (i + 1) & mask)
+                if (ctrl_[i] == t && KeyEqual()(entries_[i].key, key))
+                    return &entries_[i].value;
+            return nullptr;
+        }
+
+        std::size_t
+        size() const
+        { return size_; }
+
+        std::size_t
+        capacity() const
+        { return capacity_; }
+
+    private:
+        std::uint8_t const *ctrl_ = nullptr;
+        entry const *entries_ = nullptr;
+        std::size_t capacity_ = 0;
+        std::size_t size_ = 0;
+    };
+
+    /// Collects entries and lays them out as an image. Later additions of
+    /// an existing key are ignored.
+    struct builder
+    {
+        void
+        add(
+            Key const &key,
+            Value const &value)
+        {
+            entries_.push_back(entry { key, value });
+        }
+
+        /// Capacity of the image: a power of two at most half full.
+        std::size_t
+        capacity() const
+        {
+            std::size_t n = 16;
+            while (n < entries_.size() * 2)
+                n *= 2;
+            return n;
+        }
+
+        /// Builds the image; returns the number of distinct keys in it.
+        std::size_t
+        build(std::vector<char> &image) const
+        {
+            auto cap = capacity();
+            image.assign(image_bytes(cap), 0);
+            auto *ctrl = reinterpret_cast<std::uint8_t *>(image.data());
+            auto *slots = image.data() + entries_offset(cap);
+            auto mask = cap - 1;
+            auto source = std::vector<std::size_t>(cap);
+            std::size_t size = 0;
+            for (std::size_t n = 0 ; n < entries_.size() ; ++n)
+            {
+                auto const &e = entries_[n];
+                auto h = Hash()(e.key);
+                auto t = tag(h);
+                auto i = h & mask;
+                auto duplicate = false;
+                for (; ctrl[i] ; i = (i + 1) & mask)
+                    if (ctrl[i] == t && KeyEqual()(entries_[source[i]].key, e.key))
+                    {
+                        duplicate = true;
+                        break;
+                    }
+                if (duplicate)
+                    continue;
+                ctrl[i] = t;
+                source[i] = n;
+                std::memcpy(slots + i * sizeof(entry), &e, sizeof(entry));
+                ++size;
+            }
+            return size;
+        }
+
+    private:
+        std::vector<entry> entries_;
+    };
+};
+
+} // namespace polyfill
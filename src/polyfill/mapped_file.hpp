@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace polyfill {
+
+/// A whole file mapped read-only into memory.
+class mapped_file
+{
+public:
+    mapped_file() = default;
+
+    explicit mapped_file(std::string const &path)
+    {
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            auto err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "stat " + path);
+        }
+
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_)
+        {
+            auto *p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                auto err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(), "mmap " + path);
+            }
+            data_ = p;
+        }
+        ::close(fd);
+    }
+
+    mapped_file(mapped_file &&other) noexcept
+        : data_(std::exchange(other.data_, nullptr))
+        , size_(std::exchange(other.size_, 0))
+    {}
+
+    mapped_file &
+    operator=(mapped_file &&other) noexcept
+    {
+        if (this != &other)
+        {
+            unmap();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    ~mapped_file()
+    { unmap(); }
+
+    void const *
+    data() const
+    { return data_; }
+
+    std::size_t
+    size() const
+    { return size_; }
+
+private:
+    void
+    unmap()
+    {
+        if (data_)
+            ::munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    void *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+} // namespace polyfill
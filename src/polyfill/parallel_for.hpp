@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace polyfill {
+
+inline auto
+default_concurrency() -> std::size_t
+{
+    return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+/// Runs f(worker, i) for every i in [0, n) on up to `threads` workers.
+/// Items are handed out one at a time from a shared counter, so uneven item
+/// costs balance themselves. `worker` is in [0, threads) and lets callers
+/// keep per-worker state. The first exception thrown by any item is
+/// rethrown once all workers have stopped.
+template<class F>
+void
+parallel_for(
+    std::size_t n,
+    std::size_t threads,
+    F &&f)
+{
+    threads = std::max<std::size_t>(1, std::min(threads, n));
+    auto next = std::atomic<std::size_t>(0);
+    auto failed = std::atomic<bool>(false);
+    auto error = std::exception_ptr();
+    auto error_mutex = std::mutex();
+
+    auto work = [&](std::size_t worker) {
+        try
+        {
+            for (auto i = next++ ; i < n and not failed ; i = next++)
+                f(worker, i);
+        }
+        catch (...)
+        {
+            auto lock = std::lock_guard(error_mutex);
+            if (!error)
+                error = std::current_exception();
+            failed = true;
+        }
+    };
+
+    auto pool = std::vector<std::thread>();
+    pool.reserve(threads - 1);
+    for (std::size_t w = 1 ; w < threads ; ++w)
+        pool.emplace_back(work, w);
+    work(0);
+    for (auto &t : pool)
+        t.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+} // namespace polyfill
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+namespace polyfill {
+
+constexpr inline auto
+splitmix64(std::uint64_t &state) -> std::uint64_t
+{
+    auto z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/// xoshiro256**: small state, a few cycles per number, and statistically
+/// sound for simulation. Not for cryptographic use.
+struct xoshiro256
+{
+    using result_type = std::uint64_t;
+
+    explicit xoshiro256(std::uint64_t seed = 0)
+    {
+        for (auto &x : s_)
+            x = splitmix64(seed);
+    }
+
+    static constexpr result_type
+    min()
+    { return 0; }
+
+    static constexpr result_type
+    max()
+    { return std::numeric_limits<result_type>::max(); }
+
+    result_type
+    operator()()
+    {
+        auto result = rotl(s_[1] * 5, 7) * 9;
+        auto t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    /// A uniform integer in [0, n), by Lemire's multiply-shift. The bias is
+    /// below n / 2^64, far under anything a simulation can detect.
+    std::uint32_t
+    bounded(std::uint32_t n)
+    {
+        return static_cast<std::uint32_t>(
+            (static_cast<unsigned __int128>((*this)()) * n) >> 64);
+    }
+
+private:
+    static constexpr std::uint64_t
+    rotl(
+        std::uint64_t x,
+        int k)
+    { return (x << k) | (x >> (64 - k)); }
+
+    std::uint64_t s_[4];
+};
+
+} // namespace polyfill
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "cancellation.hpp"
+#include "flat_memo.hpp"
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace polyfill {
+
+/// A flat_memo that many threads can use at once.
+///
+/// Keys are spread over `Shards` flat_memo tables by their hash, each
+/// behind a lock of its own, so threads working on different states rarely
+/// meet on a lock. Values are copied out under the lock, as a pointer into
+/// a table would not survive another thread's insertion.
+///
+/// find_or_make() also keeps threads from computing the same entry twice:
+/// the first thread to miss on a key claims it, and others that miss on it
+/// meanwhile wait for the value instead of computing it again. A thread
+/// that waits may hold claims of its own, so callers must only nest
+/// find_or_make() calls for keys of strictly smaller problems, which rules
+/// out a cycle of waits.
+template<class Key, class Value, std::size_t Shards = 64,
+    class Hash = universal_hash, class KeyEqual = universal_equal_to>
+class sharded_memo
+{
+    static_assert((Shards & (Shards - 1)) == 0, "Shards must be a power of two");
+
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+
+    /// Splits `budget_bytes` evenly over the shards.
+    explicit sharded_memo(std::size_t budget_bytes = std::size_t(256) << 20)
+    {
+        for (auto &s : shards_)
+            s.table = flat_memo<Key, Value, Hash, KeyEqual>(budget_bytes / Shards);
+    }
+
+    sharded_memo(sharded_memo const &) = delete;
+    sharded_memo &operator=(sharded_memo const &) = delete;
+
+    /// A copy of the cached value, if there is one.
+    auto
+    find(Key const &key) -> std::optional<Value>
+    {
+        auto &s = shard_for(key);
+        auto lock = std::lock_guard(s.mutex);
+        if (auto *v = s.table.find(key))
+            return *v;
+        return std::nullopt;
+    }
+
+    /// Inserts (or overwrites) an entry.
+    void
+    insert(
+        Key const &key,
+        Value const &value)
+    {
+        auto &s = shard_for(key);
+        auto lock = std::lock_guard(s.mutex);
+        s.table.insert(key, value);
+    }
+
+    /// The value of the entry for `key`, made by make() and inserted if
+    /// there is none, and whether it was there already (or made by another
+    /// thread meanwhile). If make() throws, the claim on the key is given
+    /// up, and a thread waiting for it makes the value itself. A wait for
+    /// another thread's value gives up by throwing operation_cancelled
+    /// once `cancel`, if given, is raised, as that thread may have a later
+    /// deadline, or none.
+    template<class Make>
+    auto
+    find_or_make(
+        Key const &key,
+        Make &&make,
+        cancellation_token const *cancel = nullptr) -> std::pair<Value, bool>
+    {
+        auto &s = shard_for(key);
+        {
+            auto lock = std::unique_lock(s.mutex);
+            while (true)
+            {
+                if (auto *v = s.table.find(key))
+                    return { *v, true };
+                if (!s.claimed(key))
+                    break;
+                if (cancel)
+                    cancel->wait(s.published, lock);
+                else
+                    s.published.wait(lock);
+            }
+            s.pending.push_back(key);
+        }
+
+        auto release = [&](Value const *value) {
+            {
+                auto lock = std::lock_guard(s.mutex);
+                if (value)
+                    s.table.insert(key, *value);
+                s.unclaim(key);
+            }
+            s.published.notify_all();
+        };
+        try
+        {
+            auto value = Value(make());
+            release(&value);
+            return { value, false };
+        }
+        catch (...)
+        {
+            release(nullptr);
+            throw;
+        }
+    }
+
+    void
+    clear()
+    {
+        for (auto &s : shards_)
+        {
+            auto lock = std::lock_guard(s.mutex);
+            s.table.clear();
+        }
+    }
+
+    std::size_t
+    size() const
+    {
+        auto result = std::size_t(0);
+        for (auto &s : shards_)
+        {
+            auto lock = std::lock_guard(s.mutex);
+            result += s.table.size();
+        }
+        return result;
+    }
+
+    /// The occupancy of all shards together.
+    auto
+    occupancy() const -> memo_occupancy
+    {
+        auto result = memo_occupancy();
+        for (auto &s : shards_)
+        {
+            auto lock = std::lock_guard(s.mutex);
+            auto o = s.table.occupancy();
+            result.entries += o.entries;
+            result.slots += o.slots;
+            result.bytes += o.bytes;
+            result.budget += o.budget;
+            result.rotations += o.rotations;
+            result.evicted += o.evicted;
+        }
+        return result;
+    }
+
+    /// Visits every live entry, a shard at a time, with that shard locked.
+    template<class F>
+    void
+    for_each(F &&f) const
+    {
+        for (auto &s : shards_)
+        {
+            auto lock = std::lock_guard(s.mutex);
+            s.table.for_each(f);
+        }
+    }
+
+private:
+    struct shard
+    {
+        mutable std::mutex mutex;
+        std::condition_variable published;
+        flat_memo<Key, Value, Hash, KeyEqual> table;
+
+        /// keys being made by some thread; few at a time, so a vector
+        std::vector<Key> pending;
+
+        bool
+        claimed(Key const &key) const
+        {
+            return std::any_of(pending.begin(), pending.end(), [&](Key const &k) {
+                return KeyEqual()(k, key);
+            });
+        }
+
+        void
+        unclaim(Key const &key)
+        {
+            auto it = std::find_if(pending.begin(), pending.end(), [&](Key const &k) {
+                return KeyEqual()(k, key);
+            });
+            if (it != pending.end())
+            {
+                *it = pending.back();
+                pending.pop_back();
+            }
+        }
+    };
+
+    /// The shard is chosen by hash bits that neither the tables' slot index
+    /// (low bits) nor their tag (top bits) use.
+    auto
+    shard_for(Key const &key) -> shard &
+    { return shards_[(Hash()(key) >> 32) & (Shards - 1)]; }
+
+    std::array<shard, Shards> shards_;
+};
+
+} // namespace polyfill
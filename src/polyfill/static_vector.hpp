@@ -30,12 +30,13 @@ template <class T, std::size_t Capacity> struct static_vector {
             std::enable_if_t<std::is_copy_constructible_v<U>> * = nullptr>
   static_vector &operator=(static_vector const &other) {
     auto tmp = other;
-    *this = std::move(other);
+    *this = std::move(tmp);
+    return *this;
   }
 
   template <class U = T,
             std::enable_if_t<std::is_move_constructible_v<U>> * = nullptr>
-  static_vector(static_vector &&other) noexcept {
+  static_vector(static_vector &&other) noexcept : static_vector() {
     for (auto &&x : other)
       push_back(std::move(x));
   }
@@ -46,6 +47,7 @@ template <class T, std::size_t Capacity> struct static_vector {
     clear();
     for (auto &&x : other)
       push_back(std::move(x));
+    return *this;
   }
 
   ~static_vector() noexcept { clear(); }
@@ -69,7 +71,7 @@ template <class T, std::size_t Capacity> struct static_vector {
   T &push_back(T const &arg) {
     if (size() >= capacity())
       throw std::length_error("push_back");
-    auto *p = get(size_);
+    auto *p = get() + size_;
     p = new (p) T(arg);
     ++size_;
     return *p;
@@ -0,0 +1,192 @@
+#include <blackjack/dealer_dp.hpp>
+#include <blackjack/scenario.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using namespace blackjack;
+
+auto
+deck_rules(int decks) -> rules
+{
+    auto r = rules();
+    r.no_of_decks = decks;
+    r.cards_behind_cut = decks * 52 / 6;
+    return r;
+}
+
+/// A full shoe less the cards already dealt to the player and the dealer.
+auto
+dealt_shoe(
+    rules const &r,
+    player_hand const &p,
+    dealer_hand const &d) -> shoe
+{
+    auto s = shoe(r.no_of_decks, r.cards_behind_cut);
+    for (auto c : all_card_faces())
+    {
+        for (auto n = p[c] ; n-- ; )
+            s -= c;
+        for (auto n = d[c] ; n-- ; )
+            s -= c;
+    }
+    return s;
+}
+
+/// Compares dealer_dp against the dealer's recursion for every up-card,
+/// from full shoes and from shoes a few cards above the cut card, where
+/// the burn pile is shuffled back in. Returns false on a mismatch.
+auto
+check_dealer_dp(std::ostream &os) -> bool
+{
+    auto worst = 0.0;
+    auto compared = 0;
+    auto compare = [&](
+        rules const &r,
+        shoe const &s,
+        dealer_hand const &d,
+        cards const &burn) {
+        auto sc = scenario(r);
+        auto dp = dealer_dp();
+        auto recursive = sc.dealers_turn_impl(scenario::context(), s, d, burn, 1.0);
+        auto bottom_up = dp(r, s, d, burn);
+        for (std::size_t i = 0 ; i < recursive.p.size() ; ++i)
+        {
+            auto diff = std::abs(recursive.p[i] - bottom_up.p[i]);
+            // a NaN is as bad as it gets, and would slip past std::max
+            worst = std::isfinite(diff) ? std::max(worst, diff)
+                                        : std::numeric_limits<double>::infinity();
+        }
+        ++compared;
+    };
+    for (int decks : { 1, 2, 6, 8 })
+    {
+        auto r = deck_rules(decks);
+        for (int left : { 0, 4, 10 })
+        {
+            auto s = shoe(r.no_of_decks, r.cards_behind_cut);
+            auto burn = cards();
+            // take cards round-robin over the ranks until `left` cards are
+            // above the cut (or none are taken, for left == 0)
+            for (std::size_t i = 0 ; left and s.count() > r.cards_behind_cut + left ; ++i)
+            {
+                auto c = to_card_scale(i % nof_card_scales);
+                if (s[c])
+                {
+                    s -= c;
+                    burn += c;
+                }
+            }
+            for (auto up : all_card_faces())
+            {
+                auto d = dealer_hand(up);
+                if (!s[up])
+                    continue;
+                auto ds = s;
+                ds -= up;
+                compare(r, ds, d, burn);
+            }
+        }
+    }
+
+    // a dealer who must hit from an empty shoe, with no burn pile to
+    // reshuffle, draws nothing
+    compare(deck_rules(1), shoe(0, 0), dealer_hand(card_scale::nine), cards());
+    os << "dealer_dp: " << compared << " dealer states, largest difference " << worst << '\n';
+    return worst < 1e-12;
+}
+
+/// Checks that every action's pruned pnl lies within its reported error of
+/// the exact one, from epsilons that prune nearly everything to ones that
+/// prune little. Returns false on a violation.
+auto
+check_pruning(std::ostream &os) -> bool
+{
+    auto worst = 0.0;
+    auto largest_diff = 0.0;
+    auto largest_error = 0.0;
+    auto compared = 0;
+    auto hands = std::vector<std::pair<player_hand, dealer_hand>> {
+        { player_hand(card_scale::ten, card_scale::six), dealer_hand(card_scale::nine) },
+        { player_hand(card_scale::nine, card_scale::three), dealer_hand(card_scale::two) },
+        { player_hand(card_scale::ten, card_scale::two), dealer_hand(card_scale::four) },
+        { player_hand(card_scale::eight, card_scale::eight), dealer_hand(card_scale::six) },
+        { player_hand(card_scale::ace, card_scale::two), dealer_hand(card_scale::five) },
+    };
+    for (int decks : { 1, 2 })
+    {
+        auto r = deck_rules(decks);
+        for (auto &&[p, d] : hands)
+        {
+            auto s = dealt_shoe(r, p, d);
+            auto exact = scenario(r).evaluate(s, p, d, cards());
+            for (double epsilon : { 0.5, 0.1, 0.03, 1e-3, 1e-5 })
+            {
+                auto opts = scenario_options();
+                opts.epsilon = epsilon;
+                auto pruned = scenario(r, opts).evaluate(s, p, d, cards());
+                for (std::size_t i = 0 ; i < exact.size() ; ++i)
+                {
+                    auto diff = std::abs(pruned[i].pnl() - exact[i].pnl());
+                    largest_diff = std::max(largest_diff, diff);
+                    largest_error = std::max(largest_error, pruned[i].error);
+                    // how far the difference goes past the bound; a NaN
+                    // fails outright
+                    worst = std::isfinite(diff) ? std::max(worst, diff - pruned[i].error)
+                                                : std::numeric_limits<double>::infinity();
+                    ++compared;
+                }
+            }
+        }
+    }
+    os << "pruning: " << compared << " pruned actions, largest difference "
+       << largest_diff << ", largest error " << largest_error << '\n';
+    return worst < 1e-12;
+}
+
+struct check
+{
+    std::string_view name;
+    bool (*run)(std::ostream &);
+};
+
+constexpr check checks[] = {
+    { "dealer_dp", &check_dealer_dp },
+    { "pruning", &check_pruning },
+};
+
+} // namespace
+
+/// Runs the named checks, or all of them, and fails if any does. Each
+/// check is registered with ctest under its name.
+int
+main(
+    int argc,
+    char **argv)
+{
+    auto ok = true;
+    auto ran = 0;
+    for (auto &&c : checks)
+    {
+        auto wanted = argc == 1 or std::any_of(argv + 1, argv + argc, [&](char const *arg) {
+            return c.name == arg;
+        });
+        if (!wanted)
+            continue;
+        ok = c.run(std::cout) and ok;
+        ++ran;
+    }
+    // a name that matched no check
+    if (argc > 1 and ran != argc - 1)
+    {
+        std::cerr << "usage: " << argv[0] << " [check...]\n";
+        return 1;
+    }
+    return ok ? 0 : 1;
+}